@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+#   admission_scaling.sh
+#   Runs admission benchmark with different room numbers, student numbers and
+#   admission batch sizes and prints admissions per second of each run as CSV
+#
+#   Usage: sh bench/admission_scaling.sh [room numbers] [student numbers] [batch sizes]
+#   Example: sh bench/admission_scaling.sh "10 100 1000" "10 100 1000" "1 4 16"
+#
+
+ROOM_NUMBERS=${1:-"10 100 1000 10000"}
+STUDENT_NUMBERS=${2:-"10 100 1000"}
+BATCH_SIZES=${3:-"1"}
+BINARY=$(mktemp)
+
+cd "$(dirname "$0")/.." || exit 1
+
+gcc -O2 -pthread main.c -o "$BINARY" 2>/dev/null || exit 1
+
+echo "rooms,capacity,students,batch,admissions,seconds,admissions_per_second"
+for rooms in $ROOM_NUMBERS; do
+    for students in $STUDENT_NUMBERS; do
+        for batch in $BATCH_SIZES; do
+            "$BINARY" --bench-admission --room-number "$rooms" --student-number "$students" --admission-batch "$batch" | tail -n 1
+        done
+    done
+done
+
+rm -f "$BINARY"
@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+#   library_scaling.sh
+#   Runs same workload in pool mode with different library numbers, one
+#   worker per library, then prints throughput, waiting time, sent students
+#   and speedup against first library number as CSV
+#
+#   Usage: sh bench/library_scaling.sh [library numbers]
+#   Example: sh bench/library_scaling.sh "1 2 4 8"
+#   Other parameters are read from EXTRA_ARGS, default is shown:
+#       EXTRA_ARGS="--seat-release --student-number 200000 --room-number 400 --student-incoming-period 1000 --student-number-period 1000 --student-working-time 0 --room-cleaning-time 0 --seed 1"
+#
+
+LIBRARY_NUMBERS=${1:-"1 2 4 8"}
+EXTRA_ARGS=${EXTRA_ARGS:-"--seat-release --student-number 200000 --room-number 400 --student-incoming-period 1000 --student-number-period 1000 --student-working-time 0 --room-cleaning-time 0 --seed 1"}
+BINARY=$(mktemp)
+
+cd "$(dirname "$0")/.." || exit 1
+
+gcc -O2 -pthread main.c -o "$BINARY" 2>/dev/null || exit 1
+
+# Prints value of a column of --bench CSV result
+column(){
+    echo "$1" | awk -F, -v name="$2" 'NR == 1 { for(i = 1; i <= NF; i++) if($i == name) c = i } NR == 2 { print $c }'
+}
+
+echo "libraries,workers,seconds,students_per_second,wait_mean_ms,wait_p99_ms,index_lock_mean_ns,sent_students_percent,speedup"
+first_rate=""
+for libraries in $LIBRARY_NUMBERS; do
+    # shellcheck disable=SC2086
+    result=$("$BINARY" --bench --pool --library-number "$libraries" --worker-number "$libraries" $EXTRA_ARGS) || exit 1
+    rate=$(column "$result" students_per_second)
+    if [ -z "$first_rate" ]; then
+        first_rate=$rate
+    fi
+    echo "$libraries,$(column "$result" threads),$(column "$result" seconds),$rate,$(column "$result" wait_mean_ms),$(column "$result" wait_p99_ms),$(column "$result" index_lock_mean_ns),$(column "$result" sent_students_percent)" |
+        awk -F, -v first="$first_rate" '{ printf "%s,%.2f\n", $0, $4 / first }'
+done
+
+rm -f "$BINARY"
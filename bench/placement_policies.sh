@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+#   placement_policies.sh
+#   Builds one binary for each placement policy with -DPLACEMENT_POLICY, runs
+#   same workload with each of them, then prints throughput, waiting time and
+#   wear balance of rooms as CSV
+#   Default workload is full room model with 50000 students that arrive with
+#   poisson arrivals, 16 ms apart on average, and work 0.5 s plus an
+#   exponential time with mean 2.5 s (at most 20 s). A full room works until
+#   its longest student is done, so placement changes waiting time. In seat
+#   release model every empty seat is same and all policies wait the same
+#
+#   Usage: sh bench/placement_policies.sh [mode]
+#   Example: sh bench/placement_policies.sh --pool
+#   Other parameters are read from EXTRA_ARGS, default is shown:
+#       EXTRA_ARGS="--workload WORKLOAD --room-number 100 --room-cleaning-time 0 --seed 1"
+#   WORKLOAD is generated workload file
+#
+
+MODE=${1:-"--virtual"}
+POLICIES="most-full least-full two-choice round-robin"
+BINARY=$(mktemp)
+WORKLOAD=$(mktemp)
+
+cd "$(dirname "$0")/.." || exit 1
+
+if [ -z "$EXTRA_ARGS" ]; then
+    awk 'BEGIN {
+        srand(1)
+        time = 0
+        print "arrival_ms,working_ms"
+        for(i = 0; i < 50000; i++){
+            time += -log(1 - rand()) * 16
+            working = int(500 - log(1 - rand()) * 2500)
+            printf "%d,%d\n", time, working < 20000 ? working : 20000
+        }
+    }' > "$WORKLOAD"
+    EXTRA_ARGS="--workload $WORKLOAD --room-number 100 --room-cleaning-time 0 --seed 1"
+fi
+
+# Prints value of a column of --bench CSV result
+column(){
+    echo "$1" | awk -F, -v name="$2" 'NR == 1 { for(i = 1; i <= NF; i++) if($i == name) c = i } NR == 2 { print $c }'
+}
+
+echo "placement,seconds,students_per_second,wait_mean_ms,wait_p99_ms,wait_max_ms,room_use_deviation_percent,room_use_max_ratio"
+policy_value=0
+for policy in $POLICIES; do
+    gcc -O2 -pthread -DPLACEMENT_POLICY=$policy_value main.c -o "$BINARY" 2>/dev/null || exit 1
+    # shellcheck disable=SC2086
+    result=$("$BINARY" --bench "$MODE" $EXTRA_ARGS) || exit 1
+    echo "$(column "$result" placement),$(column "$result" seconds),$(column "$result" students_per_second),$(column "$result" wait_mean_ms),$(column "$result" wait_p99_ms),$(column "$result" wait_max_ms),$(column "$result" room_use_deviation_percent),$(column "$result" room_use_max_ratio)"
+    policy_value=$((policy_value + 1))
+done
+
+rm -f "$BINARY" "$WORKLOAD"
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+#   seat_release.sh
+#   Runs same workload in full room model and seat release model on virtual
+#   clock, then prints library time, seat utilization, waiting time and
+#   throughput gain of seat release model as CSV
+#
+#   Usage: sh bench/seat_release.sh [incoming periods] [arrival distributions]
+#   Example: sh bench/seat_release.sh "1500000 400000 100000" "uniform bursty"
+#   Other parameters are read from EXTRA_ARGS, default is shown:
+#       EXTRA_ARGS="--student-number 20000 --room-number 100 --seed 1"
+#
+
+INCOMING_PERIODS=${1:-"1500000 400000 100000"}
+DISTRIBUTIONS=${2:-"uniform"}
+EXTRA_ARGS=${EXTRA_ARGS:-"--student-number 20000 --room-number 100 --seed 1"}
+BINARY=$(mktemp)
+
+cd "$(dirname "$0")/.." || exit 1
+
+gcc -O2 -pthread main.c -o "$BINARY" 2>/dev/null || exit 1
+
+# Prints value of a column of --bench CSV result
+column(){
+    echo "$1" | awk -F, -v name="$2" 'NR == 1 { for(i = 1; i <= NF; i++) if($i == name) c = i } NR == 2 { print $c }'
+}
+
+echo "distribution,incoming_period,model,library_seconds,seat_utilization_percent,wait_mean_ms,wait_p99_ms,students_per_library_second,throughput_gain"
+for distribution in $DISTRIBUTIONS; do
+    for period in $INCOMING_PERIODS; do
+        full_seconds=""
+        for model in full_room seat_release; do
+            model_args=""
+            if [ "$model" = seat_release ]; then
+                model_args="--seat-release"
+            fi
+            # shellcheck disable=SC2086
+            result=$("$BINARY" --bench --virtual --arrival "$distribution" --student-incoming-period "$period" $model_args $EXTRA_ARGS) || exit 1
+            seconds=$(column "$result" library_seconds)
+            students=$(column "$result" students)
+            if [ -z "$full_seconds" ]; then
+                full_seconds=$seconds
+            fi
+            echo "$distribution,$period,$model,$seconds,$(column "$result" seat_utilization_percent),$(column "$result" wait_mean_ms),$(column "$result" wait_p99_ms)" |
+                awk -F, -v students="$students" -v full="$full_seconds" '{ printf "%s,%.1f,%.2f\n", $0, students / $4, full / $4 }'
+        done
+    done
+done
+
+rm -f "$BINARY"
@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+#   simulation_matrix.sh
+#   Runs whole simulation without drawing and user input for every combination
+#   of room number, room capacity, student number and execution mode, then
+#   prints students per second, waiting time, lock hold times and CPU usage
+#   of each run as CSV or JSON lines
+#
+#   Usage: sh bench/simulation_matrix.sh
+#   Matrix is read from environment variables, defaults are shown:
+#       ROOM_NUMBERS="10 100 1000"
+#       ROOM_CAPACITIES="4 16"
+#       STUDENT_NUMBERS="100 1000"
+#       MODES="thread pool:1 pool:4 virtual"   (pool:N runs pool mode with N workers)
+#       FORMAT=csv                             (csv or json)
+#       SEED=1                                 (same seed gives same arrivals in every run)
+#       EXTRA_ARGS="--student-working-time 0 --room-cleaning-time 0 --student-incoming-period 1000"
+#   Example: ROOM_NUMBERS="10" MODES="pool:1 pool:2" FORMAT=json sh bench/simulation_matrix.sh
+#
+
+ROOM_NUMBERS=${ROOM_NUMBERS:-"10 100 1000"}
+ROOM_CAPACITIES=${ROOM_CAPACITIES:-"4 16"}
+STUDENT_NUMBERS=${STUDENT_NUMBERS:-"100 1000"}
+MODES=${MODES:-"thread pool:1 pool:4 virtual"}
+FORMAT=${FORMAT:-csv}
+SEED=${SEED:-1}
+EXTRA_ARGS=${EXTRA_ARGS:-"--student-working-time 0 --room-cleaning-time 0 --student-incoming-period 1000"}
+BINARY=$(mktemp)
+
+cd "$(dirname "$0")/.." || exit 1
+
+gcc -O2 -pthread main.c -o "$BINARY" 2>/dev/null || exit 1
+
+header=1
+for rooms in $ROOM_NUMBERS; do
+    for capacity in $ROOM_CAPACITIES; do
+        for students in $STUDENT_NUMBERS; do
+            for mode in $MODES; do
+                case $mode in
+                    thread) mode_args="" ;;
+                    virtual) mode_args="--virtual" ;;
+                    pool:*) mode_args="--pool --worker-number ${mode#pool:}" ;;
+                    *) echo "Unknown mode: $mode" >&2; exit 1 ;;
+                esac
+                # shellcheck disable=SC2086
+                result=$("$BINARY" --bench --bench-format "$FORMAT" $mode_args $EXTRA_ARGS --seed "$SEED" \
+                    --room-number "$rooms" --room-capacity "$capacity" --student-number "$students") || exit 1
+                if [ "$FORMAT" = csv ] && [ $header -eq 0 ]; then
+                    result=$(echo "$result" | tail -n 1)
+                fi
+                echo "$result"
+                header=0
+            done
+        done
+    done
+done
+
+rm -f "$BINARY"
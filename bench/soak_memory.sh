@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+#   soak_memory.sh
+#   Runs an endless arrival stream for given simulation hours, then prints
+#   resident memory samples and growth of resident memory after first sample
+#   period as CSV. Last sample is taken after threads exit (the first
+#   pthread_exit loads unwinder of libgcc once), so it is not counted in growth
+#   First, an hour of simulation is run with default parameters as a
+#   regression run (a real hour in pool mode). Students leave with their
+#   rooms before their starvation tasks are due, so slots are reused while
+#   starvation tasks of previous students are still scheduled
+#
+#   Usage: sh bench/soak_memory.sh [hours] [mode]
+#   Example: sh bench/soak_memory.sh 8 --virtual
+#   Other parameters are read from EXTRA_ARGS, default is shown:
+#       EXTRA_ARGS="--student-number 10000 --room-number 1000 --student-incoming-period 20000 --student-number-period 4 --student-working-time 10 --room-cleaning-time 1 --memory-period 1800000 --seed 1"
+#
+
+HOURS=${1:-8}
+MODE=${2:-"--virtual"}
+EXTRA_ARGS=${EXTRA_ARGS:-"--student-number 10000 --room-number 1000 --student-incoming-period 20000 --student-number-period 4 --student-working-time 10 --room-cleaning-time 1 --memory-period 1800000 --seed 1"}
+BINARY=$(mktemp)
+MEMORY_LOG=$(mktemp)
+DEFAULT_LOG=$(mktemp)
+
+cd "$(dirname "$0")/.." || exit 1
+
+gcc -O2 -pthread main.c -o "$BINARY" 2>/dev/null || exit 1
+
+if ! "$BINARY" --bench "$MODE" --endless --run-time 3600000 --seed 3 --memory-log "$DEFAULT_LOG" > /dev/null < /dev/null; then
+    echo "Endless run with default parameters failed"
+    rm -f "$BINARY" "$MEMORY_LOG" "$DEFAULT_LOG"
+    exit 1
+fi
+
+# shellcheck disable=SC2086
+"$BINARY" --bench "$MODE" --endless --run-time $((HOURS * 3600000)) --memory-log "$MEMORY_LOG" $EXTRA_ARGS > /dev/null < /dev/null || exit 1
+
+cat "$MEMORY_LOG"
+echo
+echo "run,samples,left_students,first_resident_kb,max_resident_kb,growth_kb"
+for LOG in "$DEFAULT_LOG" "$MEMORY_LOG"; do
+    if [ "$LOG" = "$DEFAULT_LOG" ]; then RUN=default; else RUN=soak; fi
+    awk -F, -v run="$RUN" -v lines="$(wc -l < "$LOG")" 'NR == 3 { first = $5 } NR > 2 && NR < lines && $5 > max { max = $5 } NR > 1 { left = $3; samples++ } END { printf "%s,%d,%d,%d,%d,%d\n", run, samples, left, first, max, max - first }' "$LOG"
+done
+
+rm -f "$BINARY" "$MEMORY_LOG" "$DEFAULT_LOG"
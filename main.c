@@ -3,27 +3,73 @@
     by Furkan Kayar
 */
 
-#define _GNU_SOURCE // Defined to avoid implicit declaration warning of 'asprintf' function
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #define TRUE                    1
 #define FALSE                   0
-#define STUDENT_NUMBER          100         // Total student number
-#define STUDENT_NUMBER_PERIOD   5           // Total student number that comes in a period
-#define STUDENT_INCOMING_PERIOD 1500000     // Students comes in randomly periods max 1500 miliseconds
-#define STUDENT_WORKING_TIME    6           // After a room is full, students will work then empty room
-#define ROOM_CLEANING_TIME      1           // After each room is empty, it should be cleaned for a second to accept new students
-#define ROOM_CAPACITY           4           // Maximum student number in a room
-#define ROOM_NUMBER             10          // Room number in a library
-#define MAX_MESSAGE_NUMBER      10000       // Capacity of message array
+#define STUDENT_NUMBER          100         // Default total student number
+#define STUDENT_NUMBER_PERIOD   5           // Default total student number that comes in a period
+#define STUDENT_INCOMING_PERIOD 1500000     // Default maximum period between student groups in microseconds. Students comes in randomly periods max 1500 miliseconds
+#define STUDENT_WORKING_TIME    6           // Default working time in seconds. After a room is full, students will work then empty room
+#define ROOM_CLEANING_TIME      1           // Default cleaning time in seconds. After each room is empty, it should be cleaned for a second to accept new students
+#define ROOM_CAPACITY           4           // Default maximum student number in a room
+#define ROOM_NUMBER             10          // Default room number in a library
+#define MAX_MESSAGE_NUMBER      10000       // Default capacity of event log
+#define FRAME_RATE              10          // Default frame number that is drawn in a second
+#define ADMISSION_BATCH         1           // Default maximum student number that is seated in one admission. Students are admitted one by one if it is 1
+#define CACHE_LINE_SIZE         64          // Arrays that are shared by threads are aligned to cache lines
+#define ARENA_CHUNK_SIZE        1048576     // Size of memory chunks that arena allocates, bigger requests get their own chunk
+#define SCAN_REPEAT_NUMBER      200         // Number of full scans of rooms in scan benchmark
+#define TRACE_BUFFER_SIZE       1048576     // Size of trace buffer in bytes. Events are written to trace file when buffer is full or flush period is passed
+#define TRACE_FLUSH_PERIOD      100         // Maximum time in miliseconds that an event waits in trace buffer
+#define TRACE_MAGIC             "DEUTRACE"  // First bytes of trace file
+#define TRACE_VERSION           4           // Version of trace file format
+#define STARVATION_TIME         3000        // Miliseconds that a student works more than its working time before it leaves a room that is never full
+#define MAX_WORKING_TIME        1000000000  // Maximum working time of a student in miliseconds, so working time and STARVATION_TIME fit in int together
+#define PARAMETER_MAXIMUM       1000000000  // Maximum value of a parameter unless its uses need a smaller one
+#define SNAPSHOT_MAGIC          "DEUSNAPS"  // First bytes of checkpoint file
+#define SNAPSHOT_VERSION        7           // Version of checkpoint file format
+#define SNAPSHOT_BUFFER_SIZE    65536       // Bytes that checkpoint writer collects before each write call
+#define CHECKPOINT_PERIOD       10000       // Default real miliseconds between checkpoints
+#define MEMORY_PERIOD           60000       // Default simulation miliseconds between resident memory samples
+#define WORKLOAD_MAGIC          "DEUWORKL"  // First bytes of binary workload file
+#define WORKLOAD_VERSION        1           // Version of binary workload file format
+#define WORKLOAD_WINDOW_SIZE    4194304     // Bytes of parsed workload that stay in memory before their pages are dropped
+#define BURST_GROUP_NUMBER      8           // Student groups that come together in bursty arrivals. Mean period between groups is same as uniform arrivals
+#define HANDOFF_CAPACITY        1024        // Minimum size of handoff queue of a library. It is at least student number of library if there are several libraries
+#define HANDOFF_RETRY_PERIOD    1           // Miliseconds after which arrival task tries again when handoff queue of a library is full
+#define TWO_CHOICE_ATTEMPTS     16          // Random rooms that two choice placement tries before it takes root of room_heap
+#define SCAN_LANES              8           // Packed room arrays are padded to this element number, so vector kernels have no tail loop
+#define HISTOGRAM_SUB_BUCKETS   32          // Buckets in each power of two of histograms, error of a value is less than 1/32
+#define HISTOGRAM_BUCKETS       1568        // Buckets that cover values below 2^53 nanoseconds (about 104 days), bigger values are counted in last bucket
+#define NOT_OPENED              LONG_MIN    // opened_time of an empty room. 0 can not be used because it is a real time in virtual mode
 #define EMPTY                   0           // Indicates empty state of room
 #define ANNOUNCING              1           // Indicates announcing state of room keeper. Actually there is no physical room keeper in room it is a state of room
 #define CLEANING                2           // Indicates cleaning state of room. Room keeper can not be free so it cleans room when room is empty
@@ -31,8 +77,25 @@
 #define WORKING                 0           // Indicates working state of student
 #define WAITING                 1           // Indicates waiting state of student
 #define LEAVING                 2           // Indicates leaving state of student
+#define MOST_FULL_PLACEMENT     0           // Student is placed in most full room, then least used room. Rooms are filled one by one
+#define LEAST_FULL_PLACEMENT    1           // Student is placed in least full room, then least used room. Students are spread over rooms
+#define TWO_CHOICE_PLACEMENT    2           // Student is placed in less full of two random available rooms
+#define ROUND_ROBIN_PLACEMENT   3           // Student is placed in next available room after previously selected room
+#define EVENT_ENTERED           0           // Student has entered into library
+#define EVENT_WORKING           1           // Student is assigned to a room
+#define EVENT_LEAVING           2           // Student is sent by room
+#define EVENT_STARVED           3           // Student has left because room has never been full
+#define EVENT_OPENED            4           // Room keeper has opened the room
+#define EVENT_ANNOUNCING        5           // Room keeper has announced empty seat number
+#define EVENT_FULL              6           // Room is full
+#define EVENT_RELEASED          7           // Room has sent its students and started cleaning
+#define EVENT_CLEANED           8           // Room is cleaned and its seats are given again
 #define NOT_ENTERED             -1
 #define UNDEFINED               -1
+#define BENCHMARK_TIME          2           // Duration of admission benchmark in seconds
+#define THREAD_MODE             0           // Every student and room is run by its own thread
+#define POOL_MODE               1           // Students and rooms are tasks that are run by worker threads. Worker number is equal to core number
+#define VIRTUAL_MODE            2           // Students and rooms are tasks that are run by main thread on a virtual clock without any sleep
 
 #define PROGRAM_NAME    "DEULIB"
 #define gotoxy(x,y)     printf("\033[%d;%dH", (y), (x))
@@ -50,577 +113,6496 @@
 /*
     Room struct keeps all information about one room
     This passed to room thread as a parameter and gives thread an identity
+    Rooms are stored back to back in arena and each room starts at a cache line, so rooms that are changed by different threads never share a line. get_room must be used to reach a room because size of room depends on room capacity
+    Only fields that are scanned or changed for every student are kept here, so a room with 4 seats fits in one cache line. Lock and timing fields are in room_sync
     number: The id number of room starting from 1
     state: Stores current activity of room
-    student_number: Stores current student number in room
-    student_id_arr: Stores ids of students in the room
+    student_number: Stores number of seats that are claimed by students. Students claim seats with compare and swap so it is atomic
+    seated_number: Stores number of students that are sitting in room. It is guarded by room lock
     times_used: Indicates this room how many times used. This value is used to select rooms for students and less used room has higher priority.
+    version: Sequence number of room for readers that do not lock room. It is odd while room is locked and changed, so readers retry if it is odd or changed while they copy room
+    student_id_arr: Stores ids of students in the seats of room. Empty seats are 0. Seats are stored inside room after other fields
 */
 typedef struct working_room{
 
     int number;
+    atomic_int state;
+    atomic_int student_number;
+    int seated_number;
+    atomic_int times_used;
+    atomic_uint version;
+    int student_id_arr[];
+
+} room;
+
+/*
+    Room sync keeps lock and timing fields of one room that are not needed by scans
+    Each room sync is aligned to a cache line, so locks of different rooms never share a line
+    lock: A mutex that is used to synchronize access to seats and state of room, so releasing a room does not block other rooms. It is taken by lock_room
+    opened_time: Monotonic time in nanoseconds that first student of current usage is seated, NOT_OPENED if room is empty
+    released_time: Monotonic time in nanoseconds that room sent its students and started cleaning
+    locked_time: Monotonic time in nanoseconds that room is locked, it is only set while lock hold times are measured
+*/
+typedef struct room_sync{
+
+    _Alignas(CACHE_LINE_SIZE) sem_t lock;
+    long opened_time;
+    long released_time;
+    long locked_time;
+
+} room_sync;
+
+/*
+    Room snapshot is a consistent copy of a room that is read without locking room
+    state: State of room
+    seated_number: Number of students that are sitting in room
+    times_used: Usage number of room
+    student_id_arr: Ids of students in seats, array is given by reader and has config.room_capacity elements
+*/
+typedef struct room_snapshot{
+
     int state;
-    int student_number;
+    int seated_number;
+    int times_used;
     int* student_id_arr;
+
+} room_snapshot;
+
+/*
+    Room key is one node of room selection heap
+    It keeps copy of room values at last update of index, so heap order can not be broken by threads that change rooms at the same time
+    index: Index of room in rooms array
+    student_number: Claimed seat number of room at last update
+    times_used: Usage number of room at last update
+*/
+typedef struct room_key{
+
+    int index;
+    int student_number;
     int times_used;
 
-} room;
+} room_key;
 
 /*
     Student struct keeps all information about one student
     This passed to student thread as a parameter and gives thread an identity
     number: The id number of student starting from 1
-    state: Keeps current state of room
+    state: Keeps current state of student
     room_number: The room number that student is assigned to
+    entered_time: Monotonic time in nanoseconds that student entered library
+    queued_time: Monotonic time in nanoseconds that student is added to waiting queue
+    working_time: Monotonic time in nanoseconds that student started working
+    working_duration: Miliseconds that student works in a full room
+    library_number: Index of library that student waits or works in. It is its home library unless it is sent to another library
+    starvation_time: Elapsed miliseconds that starvation task of student is due. A starvation task that is due earlier belongs to previous student of the slot in endless mode
 */
 typedef struct student{
 
     int number;
+    atomic_int state;
+    int room_number;
+    long entered_time;
+    long queued_time;
+    long working_time;
+    int working_duration;
+    int library_number;
+    long starvation_time;
+
+} student;
+
+/*
+    Admission queue stats struct keeps live counters of waiting queue
+    length: Number of students that wait for an empty seat
+    max_length: Longest total length of queues of all libraries since start
+    oldest_age: Nanoseconds that first student of queue has waited, 0 if queue is empty
+    admitted_number: Number of empty seats that are given to students since start
+*/
+typedef struct admission_queue_stats{
+
+    int length;
+    int max_length;
+    long oldest_age;
+    long admitted_number;
+
+} admission_queue_stats;
+
+/*
+    Event struct keeps one record of event log. Messages are formatted from events after simulation end
+    Fields fill struct without padding, so records that are written to trace file have no uninitialized bytes
+    type: One of EVENT_* values
+    value: Extra value of event, it is empty seat number for announcing events
+    room_number: The room number that event belongs to, 0 if there is no room
+    student_number: The student number that event belongs to, 0 if there is no student
+    time: Time of event in miliseconds since start
+*/
+typedef struct event{
+
+    int type;
+    int value;
+    int room_number;
+    int student_number;
+    long time;
+
+} event;
+
+/*
+    One slot of event log ring buffer
+    sequence: Writers and reader use this value to know whether slot is free or written. Slot at position p is free if sequence is p and written if sequence is p + 1
+    data: Event that is stored in slot
+*/
+typedef struct event_slot{
+
+    atomic_size_t sequence;
+    event data;
+
+} event_slot;
+
+/*
+    Trace header struct is written at start of trace file. Events follow it as event structs until end of file
+    magic: TRACE_MAGIC without terminating zero
+    version: TRACE_VERSION
+    event_size: Size of one event in bytes
+    room_number: Room number of simulation
+    room_capacity: Capacity of rooms of simulation
+    student_number: Student number of simulation
+*/
+typedef struct trace_header{
+
+    char magic[8];
+    int version;
+    int event_size;
+    int room_number;
+    int room_capacity;
+    int student_number;
+    int reserved;
+
+} trace_header;
+
+/*
+    Random state struct keeps state of a xoshiro256** generator. Every thread has its own state, so random numbers need no lock
+    s: State words, they are never all zero
+*/
+typedef struct random_state{
+
+    uint64_t s[4];
+
+} random_state;
+
+/*
+    Workload record is one row of binary workload file. Rows follow a header of WORKLOAD_MAGIC, version and record size, and they are sorted by arrival time
+    arrival_time: Arrival time of students in miliseconds, any origin can be used because times are taken relative to first row
+    working_time: Working time of each student in a full room in miliseconds
+    group_size: Number of students that arrive together with the same working time
+*/
+typedef struct workload_record{
+
+    long long arrival_time;
+    int working_time;
+    int group_size;
+
+} workload_record;
+
+/*
+    Cell struct keeps one character of screen buffer
+    text: UTF-8 bytes of character, empty if terminal content is unknown
+    color: One of COLOR_* values
+*/
+typedef struct cell{
+
+    char text[4];
+    const char* color;
+
+} cell;
+
+/*
+    Histogram keeps distribution of a duration with fixed relative error like HDR histograms
+    Values are counted with relaxed atomic additions, so students and rooms never lock to record a value
+    name: Name of histogram in summary and dump
+    unit: Unit that values are printed in summary, "ms" or "us". Values are always recorded in nanoseconds
+    count: Number of recorded values
+    sum: Sum of recorded values in nanoseconds
+    max: Maximum recorded value in nanoseconds
+    buckets: Value number of each bucket. First 2 * HISTOGRAM_SUB_BUCKETS buckets keep exact values, then each power of two is divided into HISTOGRAM_SUB_BUCKETS buckets
+*/
+typedef struct histogram{
+
+    const char* name;
+    const char* unit;
+    atomic_long count;
+    atomic_long sum;
+    atomic_long max;
+    atomic_long buckets[HISTOGRAM_BUCKETS];
+
+} histogram;
+
+/*
+    Configuration struct keeps all simulation parameters. They are read from command line and configuration file
+    Default values are the macros with the same names
+*/
+typedef struct configuration{
+
+    int student_number;
+    int student_number_period;
+    int student_incoming_period;
+    int student_working_time;
+    int room_cleaning_time;
+    int room_capacity;
+    int room_number;
+    int max_message_number;
+    int frame_rate;
+    int worker_number;
+    int admission_batch;
+    int replay_speed;
+    int seed;
+    int library_number;
+    int checkpoint_period;
+    int run_time;
+    int memory_period;
+
+} configuration;
+
+/*
+    Snapshot header is written at start of checkpoint file. Sections follow it at their offsets, each offset is a multiple of 8 so file can be used after it is mapped
+    Times of students and rooms are kept relative to elapsed_time, so they are moved to clock of resumed run
+    magic: SNAPSHOT_MAGIC without terminating zero
+    version: SNAPSHOT_VERSION
+    header_size: Size of snapshot header in bytes
+    room_size: Size of one room record with its seats in bytes
+    config: Parameters of simulation
+    seat_release: seat_release of simulation
+    workload: TRUE if students come from a workload file
+    placement: Placement policy of simulation
+    arrival_distribution: Name of arrival distribution
+    elapsed_time: Simulation time in miliseconds when snapshot is taken
+    random_seed: Seed that simulation is started with
+    arrival_random: Random state of student arrivals
+    task_random: Random state of thread that takes snapshot. It is random state of tasks in virtual mode
+    arrival_trace_position: Next period of arrival trace
+    burst_position: Position of next group in its burst
+    workload_remaining: Students of current workload row that have not arrived yet
+    workload_position: Offset of next workload row
+    workload_line: Line number of next workload row
+    workload_start_time: Arrival time of first workload row
+    workload_arrival_time: Arrival time of current workload row
+    workload_working_time: Working time of current workload row
+    arrived_student_number: Number of students that arrived
+    entered_student_number: Number of students that entered library
+    left_student_number: Number of students that left library
+    max_waiting_number: Longest total length of waiting queues of all libraries since start
+    occupied_seat_time: Nanoseconds that students sat in seats
+    finished_time: Miliseconds since start when last student left
+    dropped_event_number: Number of events that could not be added to event log
+    task_number: Number of task records
+    event_number: Number of event records
+    room_offset: Offset of room records
+    student_offset: Offset of student records
+    leaving_offset: Offset of student numbers in order of leaving
+    library_offset: Offset of library records
+    queue_offset: Offset of student numbers in waiting queues and handoff queues of libraries
+    task_offset: Offset of task records, tasks of each library are in order of its heap
+    event_offset: Offset of events that are not printed yet
+    histogram_offset: Offset of counts, sums, maximums and buckets of histograms
+*/
+typedef struct snapshot_header{
+
+    char magic[8];
+    int version;
+    int header_size;
+    int room_size;
+    configuration config;
+    int seat_release;
+    int workload;
+    int placement;
+    char arrival_distribution[16];
+    long elapsed_time;
+    uint64_t random_seed;
+    random_state arrival_random;
+    random_state task_random;
+    long arrival_trace_position;
+    int burst_position;
+    int workload_remaining;
+    long workload_position;
+    long workload_line;
+    long workload_start_time;
+    long workload_arrival_time;
+    int workload_working_time;
+    int arrived_student_number;
+    int entered_student_number;
+    int left_student_number;
+    int max_waiting_number;
+    long occupied_seat_time;
+    long finished_time;
+    long dropped_event_number;
+    long task_number;
+    long event_number;
+    long room_offset;
+    long student_offset;
+    long leaving_offset;
+    long library_offset;
+    long queue_offset;
+    long task_offset;
+    long event_offset;
+    long histogram_offset;
+
+} snapshot_header;
+
+/*
+    Snapshot room is record of a room in checkpoint file. Ids of students in seats follow it
+    state, student_number, seated_number, times_used: Same fields of room
+    opened_time: opened_time of room relative to snapshot time, NOT_OPENED if room is empty
+    released_time: released_time of room relative to snapshot time
+*/
+typedef struct snapshot_room{
+
+    int state;
+    int student_number;
+    int seated_number;
+    int times_used;
+    long opened_time;
+    long released_time;
+
+} snapshot_room;
+
+/*
+    Snapshot student is record of a student in checkpoint file
+    state, room_number, library_number, working_duration: Same fields of student
+    entered_time, queued_time, working_time: Times of student relative to snapshot time
+*/
+typedef struct snapshot_student{
+
     int state;
     int room_number;
+    int library_number;
+    int working_duration;
+    long entered_time;
+    long queued_time;
+    long working_time;
+
+} snapshot_student;
+
+/*
+    Snapshot library is record of a library in checkpoint file. Its waiting students and then its handoff students are in queue section, its tasks are in task section
+    waiting_number: Number of students in waiting queue
+    handoff_number: Number of students in handoff queue
+    task_number: Number of tasks in task heap
+    max_waiting_number, empty_seat_number, placement_cursor, admitted_number, received_number, task_sequence: Same fields of library
+*/
+typedef struct snapshot_library{
+
+    int waiting_number;
+    int handoff_number;
+    int task_number;
+    int max_waiting_number;
+    int empty_seat_number;
+    int placement_cursor;
+    long admitted_number;
+    long received_number;
+    long task_sequence;
+
+} snapshot_library;
+
+/*
+    Snapshot task is record of a task in checkpoint file
+    time: Time of task in miliseconds since start
+    sequence: Scheduling order of task
+    function: Index of function in task_functions
+    argument: Index of student or room that task works on, -1 if it has no argument
+*/
+typedef struct snapshot_task{
+
+    long time;
+    long sequence;
+    int function;
+    int argument;
+
+} snapshot_task;
+
+/*
+    Parameter struct describes one configuration parameter
+    name: Name of parameter in configuration file. Command line option is same name with '-' instead of '_'
+    value: Field of config that parameter is stored in
+    minimum: Minimum accepted value
+    maximum: Maximum accepted value. Values that are multiplied by other values are limited, so their products fit in their types
+    description: Explanation that is printed in usage
+*/
+typedef struct parameter{
+
+    const char* name;
+    int* value;
+    int minimum;
+    int maximum;
+    const char* description;
+
+} parameter;
+
+/*
+    Pointer room is a room that is allocated alone with its seats in another allocation
+    It is only used by scan benchmark to compare old layout of rooms with arena layout
+*/
+typedef struct pointer_room{
+
+    int number;
+    atomic_int state;
+    atomic_int student_number;
+    int seated_number;
+    int* student_id_arr;
+    atomic_int times_used;
+
+} pointer_room;
+
+/*
+    Task struct keeps one scheduled job of worker pool
+    time: Time that task will be run in miliseconds since start
+    sequence: Scheduling order of task. Tasks that have same time are run in scheduling order
+    function: Function that will be run
+    argument: Parameter of function, it is a student or a room
+*/
+typedef struct task{
+
+    long time;
+    long sequence;
+    void (*function)(void*);
+    void* argument;
+
+} task;
+
+/*
+    One slot of handoff queue of a library
+    sequence: Writers and readers use this value to know whether slot is free or written, like slots of event log
+    data: Student that is sent to library
+*/
+typedef struct handoff_slot{
+
+    atomic_size_t sequence;
+    student* data;
+
+} handoff_slot;
+
+/*
+    Library struct keeps room index, admission queue and task heap of one library of campus
+    Each library has its own locks, so students of different libraries never wait for each other. Libraries reach each other only through handoff queues
+    number: Index of library in libraries array
+    first_room: Index of first room of library in rooms array
+    room_number: Number of rooms of library
+    index_mutex: A mutex that is used to synchronize access to room index of library
+    index_locked_time: Monotonic time in nanoseconds that index mutex is locked
+    room_heap: Binary heap of rooms of library that can accept a student. Root of heap is the most full less used room
+    room_heap_pos: Position of each room of library in room_heap, -1 if room is not in heap
+    room_heap_size: Number of rooms in room_heap
+    room_occupancy: Student number of each room of library if room is available, -1 otherwise. Packed for vectorized room scan
+    room_usage: times_used of each room of library. Packed for vectorized room scan
+    room_scan_size: Element number of packed room arrays, room number rounded up to SCAN_LANES
+    waiting_mutex: A mutex that is used to synchronize access to waiting queue and its counters
+    waiting_queue: FIFO ring of students that wait for an empty seat. Seats are given in order of arrival. It grows when it is full
+    waiting_capacity: Size of waiting_queue
+    waiting_head: Index of first waiting student in waiting_queue
+    waiting_number: Number of waiting students. Other libraries read it without lock to find least loaded library
+    empty_seat_number: Number of empty seats that are not given to any student. Other libraries read it without lock to find least loaded library
+    max_waiting_number: Longest length of waiting queue since start
+    admitted_number: Number of empty seats that are given to students since start
+    admission_group: Students that are taken from waiting queue to be admitted together. Only one thread admits a group at a time
+    admitting: TRUE while a group is admitted. Students that come meanwhile are admitted by same thread in its next group
+    task_mutex: A mutex that is used to synchronize access to task_heap
+    task_sem: Posted when a task is scheduled or a student is sent to library. Idle workers of library wait on it
+    task_heap: Binary heap of tasks of students and rooms of library. Root of heap is the earliest task
+    task_heap_size: Number of tasks in task_heap
+    task_heap_capacity: Allocated size of task_heap, it grows when it is full
+    task_sequence: Scheduling order of next task
+    handoff_queue: Ring of students that are sent to library by arrivals or by other libraries that have no empty seat. It is used without any lock
+    handoff_capacity: Size of handoff_queue, it is a power of two
+    handoff_head: Position that next student will be written
+    handoff_tail: Position that next student will be read
+    received_number: Number of students that came from another library because their library had no empty seat
+    placement_cursor: Index of room in library that round robin placement checks first
+*/
+typedef struct library{
+
+    _Alignas(CACHE_LINE_SIZE) int number;
+    int first_room;
+    int room_number;
+    sem_t index_mutex;
+    long index_locked_time;
+    room_key* room_heap;
+    int* room_heap_pos;
+    int room_heap_size;
+    int* room_occupancy;
+    int* room_usage;
+    int room_scan_size;
+    sem_t waiting_mutex;
+    student** waiting_queue;
+    int waiting_capacity;
+    int waiting_head;
+    atomic_int waiting_number;
+    atomic_int empty_seat_number;
+    int max_waiting_number;
+    long admitted_number;
+    student** admission_group;
+    BOOL admitting;
+    sem_t task_mutex;
+    sem_t task_sem;
+    task* task_heap;
+    int task_heap_size;
+    int task_heap_capacity;
+    long task_sequence;
+    handoff_slot* handoff_queue;
+    size_t handoff_capacity;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t handoff_head;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t handoff_tail;
+    atomic_long received_number;
+    int placement_cursor;
+
+} library;
+
+
+void parse_arguments(int, char**);
+BOOL set_parameter(const char*, const char*);
+BOOL is_valid_configuration(const configuration*);
+BOOL set_placement(const char*);
+void load_config_file(const char*);
+void print_usage(const char*);
+void* arena_alloc(size_t, size_t);
+room* get_room(int);
+library* get_student_library(student*);
+library* get_room_library(room*);
+void run_scan_benchmark(void);
+long scan_arena_rooms(void);
+long scan_pointer_rooms(pointer_room**);
+int open_cache_miss_counter(void);
+long read_cache_miss_counter(int);
+void init_room_student(void);
+void init_libraries(void);
+void init_student_slots(void);
+student* take_free_student(void);
+void free_student(student*);
+void init_semaphores(void);
+int init_threads(pthread_t*, void*, void*, size_t, int, int);
+void join_threads(pthread_t*, int);
+void init_random(void);
+void seed_random(random_state*, uint64_t, uint64_t);
+uint64_t next_random(random_state*);
+int random_below(random_state*, int);
+double random_exponential(random_state*);
+random_state* get_thread_random(void);
+long uniform_arrival_gap(void);
+long poisson_arrival_gap(void);
+long bursty_arrival_gap(void);
+long trace_arrival_gap(void);
+void load_arrival_trace(const char*);
+void unmap_trace(event*, size_t);
+void open_workload(const char*);
+BOOL read_workload_row(long*, int*, int*);
+BOOL parse_workload_number(char**, char*, long*);
+BOOL peek_workload_arrival(long*);
+void take_workload_student(student*);
+void wait_workload_arrival(student*);
+void arrive_student(student*);
+void request_admission(student*);
+int receive_students(library*);
+library* find_spare_library(library*);
+BOOL push_handoff(library*, student*);
+BOOL has_handoff_space(student*);
+student* pop_handoff(library*);
+int get_room_working_time(room*);
+void sleep_miliseconds(long);
+void leave_room(student*);
+void seat_release_task(void*);
+double get_seat_utilization(void);
+long get_sent_student_number(void);
+void* student_thread(void*);
+void* room_thread(void*);
+int get_most_full_room(library*);
+int get_placement_room(library*);
+int get_two_choice_room(library*);
+int get_round_robin_room(library*);
+int select_room(library*);
+BOOL claim_seat(room*);
+int claim_seats(room*, int);
+int select_rooms(library*, student**, int);
+void admit_students(library*, student**, int);
+void enqueue_student(student*);
+BOOL enter_admission_queue(student*);
+int take_empty_seats(library*, int);
+void free_seats(library*, int);
+void give_seat(student*);
+void push_waiting_student(student*);
+student* pop_waiting_student(library*);
+int copy_waiting_students(int*, int);
+void read_admission_queue(admission_queue_stats*);
+void admit_waiting_students(library*);
+BOOL seat_student(student*);
+void take_seat(room*, int);
+void lock_room(room*);
+void unlock_room(room*);
+void read_room(room*, room_snapshot*);
+void leave_seat(room*, int);
+void release_room(room*);
+void refresh_room_index(room*);
+BOOL announce_room(room*);
+void mark_room_busy(room*);
+BOOL starve_student(student*);
+void wake_student(student*);
+void run_admission_benchmark(void);
+void* admission_benchmark_thread(void*);
+void admit_benchmark_groups(student*);
+void* print_simulation(void);
+void draw_simulation(int);
+void init_screen(void);
+void clear_screen_buffer(void);
+void screen_print(int, int, const char*, const char*, ...);
+void flush_screen(void);
+void init_event_log(size_t);
+BOOL add_event(int, int, int, int);
+BOOL take_event(event*);
+void print_event(event*);
+void open_trace(const char*);
+void* trace_thread(void*);
+void write_trace_events(void);
+void flush_trace_buffer(void);
+void close_trace(void);
+void open_metrics_socket(const char*);
+void* metrics_thread(void*);
+void write_metrics(FILE*);
+BOOL send_all(int, const char*, size_t);
+void close_metrics_socket(void);
+void init_signals(void);
+void stop_signals(void);
+void* signal_thread(void*);
+BOOL is_stop_requested(void);
+void close_arrivals(long);
+void finish_simulation(void);
+void open_memory_log(const char*);
+void* memory_thread(void*);
+void write_memory_sample(void);
+void close_memory_log(void);
+long get_resident_memory(void);
+void init_checkpoint_lock(void);
+void start_checkpoints(void);
+void stop_checkpoints(void);
+void* checkpoint_thread(void*);
+void take_checkpoint(void);
+BOOL wait_checkpoint(int);
+void lock_simulation(void);
+void unlock_simulation(void);
+BOOL write_snapshot(void);
+void set_snapshot_layout(snapshot_header*, long);
+void write_snapshot_bytes(const void*, size_t);
+BOOL flush_snapshot_buffer(void);
+int get_task_function(void (*)(void*));
+int get_task_argument(task*);
+void load_snapshot(const char*);
+BOOL is_valid_snapshot(snapshot_header*);
+void restore_snapshot(void);
+long get_real_time(void);
+event* map_trace(const char*, trace_header*, size_t*);
+BOOL is_valid_trace_event(const event*, const trace_header*);
+void apply_trace_event(event*);
+void remove_waiting_student(student*);
+void run_replay(const char*);
+void run_trace_analysis(const char*);
+int compare_ints(const void*, const void*);
+long get_elapsed_time(void);
+long get_monotonic_time(void);
+void record_latency(histogram*, long);
+int get_histogram_bucket(long);
+long get_bucket_limit(int);
+long get_percentile(histogram*, double);
+void record_entering(student*);
+void record_working(student*);
+void record_cleaning(room*);
+void print_latency_summary(void);
+void lock_index(library*);
+void unlock_index(library*);
+void print_benchmark_result(double, double, long);
+double get_cpu_time(void);
+long get_context_switches(void);
+void dump_latency_histograms(const char*);
+void add_outgoing_student(student*);
+void init_room_index(void);
+void update_room_index(room*);
+BOOL is_room_available(room*);
+int comparator(room_key*, room_key*);
+void init_room_scan(void);
+int find_best_room_scalar(const int*, const int*, int);
+int find_best_room_sse2(const int*, const int*, int);
+int find_best_room_avx2(const int*, const int*, int);
+void run_room_scan_benchmark(void);
+void swap_heap_nodes(library*, int, int);
+void sift_up(library*, int);
+void sift_down(library*, int);
+void run_pool(void);
+void run_virtual(void);
+void init_task_queue(void);
+void* worker_thread(void*);
+task take_task(library*);
+void schedule_task(library*, void (*)(void*), void*, long);
+BOOL task_before(task*, task*);
+void student_arrival_task(void*);
+void request_seat(student*);
+void admit_student_task(void*);
+void starvation_task(void*);
+void leave_task(void*);
+void release_task(void*);
+void cleaned_task(void*);
+
+
+configuration config = {
+    STUDENT_NUMBER, STUDENT_NUMBER_PERIOD, STUDENT_INCOMING_PERIOD, STUDENT_WORKING_TIME,
+    ROOM_CLEANING_TIME, ROOM_CAPACITY, ROOM_NUMBER, MAX_MESSAGE_NUMBER, FRAME_RATE, 0, ADMISSION_BATCH, 1, 0, 1, CHECKPOINT_PERIOD, 0, MEMORY_PERIOD
+};                                          // Simulation parameters
+parameter parameters[] = {
+    { "student_number",          &config.student_number,          1, PARAMETER_MAXIMUM, "Total student number" },
+    { "student_number_period",   &config.student_number_period,   1, PARAMETER_MAXIMUM, "Student number that comes in a period" },
+    { "student_incoming_period", &config.student_incoming_period, 1, PARAMETER_MAXIMUM, "Maximum period between student groups in microseconds" },
+    { "student_working_time",    &config.student_working_time,    0, MAX_WORKING_TIME / 1000, "Working time of students in a full room in seconds" },
+    { "room_cleaning_time",      &config.room_cleaning_time,      0, MAX_WORKING_TIME / 1000, "Cleaning time of a room in seconds" },
+    { "room_capacity",           &config.room_capacity,           1, 1000000, "Maximum student number in a room" },
+    { "room_number",             &config.room_number,             1, 100000000, "Room number in library" },
+    { "max_message_number",      &config.max_message_number,      1, PARAMETER_MAXIMUM, "Capacity of event log" },
+    { "frame_rate",              &config.frame_rate,              1, PARAMETER_MAXIMUM, "Frame number that is drawn in a second" },
+    { "worker_number",           &config.worker_number,           0, PARAMETER_MAXIMUM, "Worker thread number of pool mode, 0 is core number" },
+    { "admission_batch",         &config.admission_batch,         1, PARAMETER_MAXIMUM, "Maximum waiting student number that is seated in one admission" },
+    { "replay_speed",            &config.replay_speed,            1, PARAMETER_MAXIMUM, "Trace miliseconds that --replay shows in a real milisecond" },
+    { "seed",                    &config.seed,                    0, PARAMETER_MAXIMUM, "Seed of all random numbers, 0 takes seed from current time" },
+    { "library_number",          &config.library_number,          1, PARAMETER_MAXIMUM, "Library number of campus, rooms and students are divided between libraries" },
+    { "checkpoint_period",       &config.checkpoint_period,       1, PARAMETER_MAXIMUM, "Real miliseconds between checkpoints of --checkpoint" },
+    { "run_time",                &config.run_time,                0, PARAMETER_MAXIMUM, "Simulation miliseconds after which students stop coming, 0 does not stop them" },
+    { "memory_period",           &config.memory_period,           1, PARAMETER_MAXIMUM, "Simulation miliseconds between resident memory samples of --memory-log" },
+};                                          // Parameters that can be set from command line and configuration file
+BOOL benchmark_mode = FALSE;                // Admission benchmark is run instead of simulation if it is TRUE
+BOOL headless = FALSE;                      // Simulation is not drawn if it is TRUE. Virtual mode is always headless
+BOOL simulation_benchmark_mode = FALSE;     // Simulation is run without drawing and waiting for user, then results are printed as one line if it is TRUE
+const char* benchmark_format = "csv";       // Format of simulation benchmark result, "csv" or "json"
+BOOL measure_locks = FALSE;                 // Hold times of room and index locks are recorded if it is TRUE. It is enabled by simulation benchmark
+const char* stats_file = NULL;              // Histograms are written to this file as JSON if it is given
+const char* trace_file = NULL;              // Events are streamed to this file as binary records if it is given
+const char* replay_file = NULL;             // Trace that is drawn like a running simulation instead of running simulation
+const char* analysis_file = NULL;           // Trace that is analyzed instead of running simulation
+int trace_fd = -1;                          // File descriptor of trace_file, -1 if tracing is not started
+char* trace_buffer;                         // Events that are not written to trace file yet
+size_t trace_buffer_used = 0;               // Used bytes of trace_buffer
+long trace_flushed_time = 0;                // Monotonic time in nanoseconds of last write to trace file
+long traced_event_number = 0;               // Number of events that are written to trace_buffer
+atomic_int trace_running;                   // Trace thread works until this value is FALSE
+pthread_t trace_t;                          // Thread that writes events to trace file in thread and pool modes
+const char* metrics_socket_path = NULL;     // Live counters are served on this Unix socket if it is given
+int metrics_fd = -1;                        // Listening socket of metrics server, -1 if it is not started
+pthread_t metrics_t;                        // Thread that serves metrics to clients
+long metrics_admitted_number = 0;           // Admissions until previous scrape, it is used to find admissions per second
+long metrics_scraped_time = 0;              // Monotonic time in nanoseconds of previous scrape
+const char* checkpoint_file = NULL;         // Snapshots of simulation are written to this file periodically if it is given
+const char* resume_file = NULL;             // Simulation continues from this snapshot if it is given
+snapshot_header* resume_snapshot = NULL;    // Mapped snapshot that simulation is resumed from
+size_t resume_size = 0;                     // Size of resume_snapshot in bytes
+pthread_rwlock_t checkpoint_lock;           // Pool workers and trace thread hold it for reading while they change simulation, checkpoint thread holds it for writing while it forks
+pthread_t checkpoint_t;                     // Thread that takes checkpoints in pool mode
+sem_t checkpoint_stop_sem;                  // Posted when pool stops, so checkpoint thread does not wait for its next period
+pid_t checkpoint_pid = -1;                  // Process that writes current snapshot, -1 if none
+long checkpoint_number = 0;                 // Number of snapshots that are written completely
+char checkpoint_temporary[PATH_MAX];        // Snapshot is written to this file and renamed to checkpoint_file, so an interrupted write never breaks previous snapshot
+char snapshot_buffer[SNAPSHOT_BUFFER_SIZE]; // Bytes that checkpoint writer has not written yet. It is only used by writer process
+size_t snapshot_buffer_used = 0;            // Used bytes of snapshot_buffer
+int snapshot_fd = -1;                       // File that checkpoint writer writes
+BOOL snapshot_failed = FALSE;               // Indicates a write of checkpoint writer failed
+void (*task_functions[])(void*) = { student_arrival_task, admit_student_task, starvation_task, leave_task, seat_release_task, release_task, cleaned_task }; // Functions of tasks that can be saved in a snapshot, a task is saved with index of its function
+atomic_long entered_student_number = 0;     // Number of students that entered library. Students by state are found from this and other counters without scanning students
+uint64_t random_seed = 0;                   // Seed that is used, it is config.seed or current time
+random_state arrival_random;                // Random state of student arrivals. Only one thread creates students at a time, so arrivals do not depend on thread scheduling
+_Thread_local random_state thread_random;   // Random state of current thread for other random numbers
+_Thread_local BOOL thread_random_seeded = FALSE; // Indicates thread_random is seeded
+atomic_int random_stream_number = 1;        // Stream of next seeded thread. Stream 0 is student arrivals
+const char* arrival_distribution = "uniform"; // Distribution of periods between student groups, "uniform", "poisson", "bursty" or "trace"
+const char* arrival_trace_file = NULL;      // Trace whose arrival periods are repeated by trace distribution
+long (*next_arrival_gap)(void) = NULL;      // Returns period before next student group in microseconds, it is selected by init_random
+long* arrival_trace_gaps = NULL;            // Periods between student groups of arrival trace in microseconds
+size_t arrival_trace_gap_number = 0;        // Size of arrival_trace_gaps
+size_t arrival_trace_position = 0;          // Next period of arrival_trace_gaps
+int burst_position = 0;                     // Position of next group in its burst
+const char* workload_file = NULL;           // Arrivals and working times of students are read from this file instead of arrival distribution if it is given
+char* workload_data = NULL;                 // Mapped workload file, rows are parsed while students arrive
+size_t workload_size = 0;                   // Size of workload file in bytes
+size_t workload_position = 0;               // Offset of next row in workload_data
+size_t workload_dropped = 0;                // Pages of workload_data before this offset are dropped
+size_t workload_line = 0;                   // Line number of next row, it is used in error messages of CSV workloads
+BOOL workload_binary = FALSE;               // Indicates workload file has workload records instead of CSV lines
+long workload_start_time = -1;              // Arrival time of first row, arrivals are relative to it
+long workload_arrival_time = 0;             // Arrival time of current row in miliseconds since start
+int workload_working_time = 0;              // Working time of students of current row in miliseconds
+int workload_remaining = 0;                 // Students of current row that have not arrived yet
+atomic_long occupied_seat_time = 0;         // Sum of nanoseconds that students sat in seats, in simulation or in trace that is replayed or analyzed
+long finished_time = 0;                     // Miliseconds since start when last student left
+histogram wait_histogram = { .name = "wait", .unit = "ms" };                 // Time from entering library to starting to work
+histogram room_time_histogram = { .name = "room_time", .unit = "ms" };       // Time from starting to work to being sent by room
+histogram starvation_histogram = { .name = "starvation", .unit = "ms" };     // Time from starting to work to leaving because room has never been full
+histogram fill_histogram = { .name = "fill", .unit = "ms" };                 // Time from opening room to room being full
+histogram cleaning_histogram = { .name = "cleaning", .unit = "ms" };         // Time from sending students to giving seats again
+histogram room_lock_histogram = { .name = "room_lock", .unit = "us" };       // Hold time of room locks
+histogram index_lock_histogram = { .name = "index_lock", .unit = "us" };     // Hold time of room selection index lock
+histogram* histograms[] = { &wait_histogram, &room_time_histogram, &starvation_histogram, &fill_histogram, &cleaning_histogram, &room_lock_histogram, &index_lock_histogram };
+int histogram_number = 5;                   // Number of histograms that are reported. Lock histograms are last and they are reported only if lock hold times are measured
+student* students;                          // An struct array that keeps all students and their information
+room* rooms;                                // First room in arena. Rooms are reached by get_room
+size_t room_stride;                         // Distance between rooms in bytes. It is multiple of cache line size
+room_sync* room_syncs;                      // Lock and timing fields of rooms, index is room number - 1
+char* arena_chunk = NULL;                   // Memory chunk that arena allocates from
+size_t arena_used = 0;                      // Used bytes of arena_chunk
+size_t arena_chunk_size = 0;                // Size of arena_chunk
+BOOL scan_benchmark_mode = FALSE;           // Scan benchmark is run instead of simulation if it is TRUE
+event_slot* event_log;                      // Ring buffer of events that are sent by students and rooms. Threads add events without any lock
+size_t event_log_capacity;                  // Number of slots in event_log
+atomic_size_t event_log_head;               // Position that next event will be written
+size_t event_log_tail;                      // Position that next event will be read. Only one thread reads event log
+atomic_size_t dropped_event_number;         // Number of events that could not be added because event log was full
+sem_t* rooms_sem;                           // A semaphore array of rooms. This semaphores initialized with 0 value. Student that fills a room posts its semaphore, so room keeper sleeps until room is full
+sem_t* leaving_sem;                         // A semaphore array of students. Room posts semaphore of student when it changes state of student as leaving. So, students sleep while they are working instead of checking their state continuously
+sem_t finish_sem;                           // A semaphore that is posted when the last student left from library. Main thread waits on it
+atomic_int total_outgoing_student_number;   // Keeps total student number that left from library
+atomic_int waiting_student_total = 0;       // Number of students in waiting queues of all libraries
+atomic_int max_waiting_student_total = 0;   // Longest value of waiting_student_total since start
+atomic_int* leaving_order;                  // Numbers of students in order of leaving. Slot is 0 until student number is written, so renderer reads it without scanning students
+cell* front_screen;                         // Characters that terminal shows now
+cell* back_screen;                          // Characters of frame that is being drawn
+char* screen_output;                        // Escape sequences of changed cells, written to terminal with one write call
+int screen_width = 0;                       // Column number of screen buffers
+int screen_height = 0;                      // Row number of screen buffers
+atomic_long benchmark_admission_number;     // Number of admissions that are done in admission benchmark
+atomic_int benchmark_running;               // Admission benchmark threads work until this value is FALSE
+sem_t benchmark_start_sem;                  // Admission benchmark threads wait on this semaphore until all of them are created
+int (*find_best_room)(const int*, const int*, int) = find_best_room_scalar; // Room scan kernel that is selected for CPU by init_room_scan
+const char* room_scan_kernel = "scalar";    // Name of selected room scan kernel
+BOOL linear_selection = FALSE;              // Rooms are selected by scanning packed room arrays instead of root of room_heap if it is TRUE
+#ifdef PLACEMENT_POLICY
+const int placement_policy = PLACEMENT_POLICY; // Placement policy is fixed when program is compiled with -DPLACEMENT_POLICY=N, so compiler removes other policies from selection
+#else
+int placement_policy = MOST_FULL_PLACEMENT; // Rule that selects room of a student, it is set by --placement
+#endif
+const char* placement_names[] = { "most-full", "least-full", "two-choice", "round-robin" }; // Names of placement policies in order of their values
+BOOL audit_index = FALSE;                   // Root of room_heap is checked against a scan of packed room arrays on every selection if it is TRUE
+BOOL seat_release = FALSE;                  // Students leave after their own working time and free their seats one by one if it is TRUE. Rooms are never busy or cleaned
+BOOL room_scan_benchmark_mode = FALSE;      // Room scan kernels are benchmarked instead of simulation if it is TRUE
+int execution_mode = THREAD_MODE;           // THREAD_MODE, POOL_MODE or VIRTUAL_MODE
+long virtual_time = 0;                      // Current time of virtual clock in miliseconds. Only main thread changes it in virtual mode
+atomic_int pool_running;                    // Workers run until this value is FALSE
+atomic_int next_worker_number = 0;          // Number of next worker that starts, it selects library and core of worker
+int pool_worker_number = 0;                 // Worker number of pool mode, 0 in other modes
+library* libraries;                         // Libraries of campus. Each has its own rooms, room index, admission queue and task heap
+sem_t* seat_sem;                            // A semaphore array of students. Semaphore of a waiting student is posted when an empty seat is given to it, or after it is seated by batched admission in thread mode
+int arrived_student_number = 0;             // Number of students that arrived in pool mode. Only arrival task changes it
+BOOL endless_mode = FALSE;                  // Students keep coming until run_time is reached or program is stopped. student_number is number of student slots and slot of a leaving student is used again. It is set by --endless
+atomic_int stop_requested = FALSE;          // Set by signal thread when SIGINT or SIGTERM is received. Students stop coming and students in library leave before program ends
+atomic_long closed_arrival_number = -1;     // Number of students that arrived before arrivals are stopped, -1 while students are coming
+atomic_int simulation_finished = FALSE;     // TRUE after last student left. Room threads and virtual clock stop when it is TRUE
+atomic_long left_student_total = 0;         // Number of students that left library, students of a reused slot are counted each time
+int* free_student_slots;                    // Indexes of students that are out of library in endless mode, it is used as a stack
+int free_student_number = 0;                // Number of indexes in free_student_slots
+sem_t free_student_mutex;                   // A mutex that is used to synchronize access to free_student_slots
+pthread_t signal_t;                         // Thread that waits for SIGINT and SIGTERM. Other threads block them, so a signal never interrupts a lock or a sleep
+const char* memory_log_file = NULL;         // Resident memory is appended to this file every memory_period miliseconds of simulation if it is given
+FILE* memory_log = NULL;                    // Opened memory_log_file
+pthread_t memory_t;                         // Thread that samples resident memory in thread and pool modes
+sem_t memory_stop_sem;                      // Posted when simulation ends, so memory thread does not wait for its next period
+struct winsize window;                      // Used to get terminal size
+struct timeval start;                       // Used to reach current time unit of nanoseconds
+
+
+
+int main(int argc, char** argv){
+
+    int i = 0;
+    parse_arguments(argc, argv);
+    if((linear_selection || audit_index) && placement_policy != MOST_FULL_PLACEMENT){
+        printf("Room scan selects most full room, --linear-selection and --audit-index can only be used with most-full placement\n");
+        return 1;
+    }
+    if((long)config.room_capacity * config.room_number > INT_MAX){ // Seat numbers of libraries are int
+        printf("Seat number (room capacity x room number) must be at most %d\n", INT_MAX);
+        return 1;
+    }
+    if((checkpoint_file != NULL || resume_file != NULL) && execution_mode == THREAD_MODE){
+        printf("Checkpoints can only be used with --pool or --virtual\n");
+        return 1;
+    }
+    if(endless_mode && (execution_mode == THREAD_MODE || checkpoint_file != NULL || resume_file != NULL || workload_file != NULL)){
+        printf("Endless mode can only be used with --pool or --virtual, without checkpoints and workload\n");
+        return 1;
+    }
+    if(resume_file != NULL){
+        load_snapshot(resume_file); // Parameters of simulation are taken from snapshot
+    }
+    init_random();
+    if(benchmark_mode){
+        run_admission_benchmark();
+        return 0;
+    }
+    if(scan_benchmark_mode){
+        run_scan_benchmark();
+        return 0;
+    }
+    if(room_scan_benchmark_mode){
+        run_room_scan_benchmark();
+        return 0;
+    }
+    if(analysis_file != NULL){
+        run_trace_analysis(analysis_file);
+        return 0;
+    }
+    if(replay_file != NULL){
+        run_replay(replay_file);
+        return 0;
+    }
+
+    ioctl(0, TIOCGWINSZ, &window);
+
+    if(simulation_benchmark_mode){
+        headless = TRUE;
+        measure_locks = TRUE;
+    }
+    if(measure_locks){
+        histogram_number = sizeof(histograms) / sizeof(histograms[0]);
+    }
+    if(execution_mode == VIRTUAL_MODE){
+        headless = TRUE; // There is nothing to draw while virtual clock runs
+    }
+    if(!headless && (window.ws_col < 110 || window.ws_row < 45)){
+        puts("Please stretch your terminal to run simulation properly\nPress " COLOR_YELLOW "\033[1mENTER\033[0m" COLOR_RESET " to continue...");
+        getchar();
+    }
+
+    if(workload_file != NULL){
+        open_workload(workload_file); // Student number is taken from workload
+    }
+
+    pthread_t* students_t = (pthread_t*) malloc(sizeof(pthread_t) * config.student_number); // Student threads
+    pthread_t* rooms_t = (pthread_t*) malloc(sizeof(pthread_t) * config.room_number);       // Room threads
+    pthread_t simulation_t[1];              // Simulation thread
+
+    init_signals();      // Signals are blocked before any thread is created, so only signal thread receives them
+    init_room_student(); // Initializing student and room arrays with default values
+    if(endless_mode){
+        init_student_slots(); // All students are out of library at start
+    }
+    init_room_index();   // Initializing room selection index
+    init_event_log(config.max_message_number); // Initializing event log
+    init_semaphores();   // Initializing semaphores
+    if(checkpoint_file != NULL){
+        init_checkpoint_lock(); // Trace thread and workers use it
+    }
+    if(trace_file != NULL){
+        open_trace(trace_file); // Events are streamed to trace file instead of waiting in event log until end
+    }
+    if(metrics_socket_path != NULL){
+        open_metrics_socket(metrics_socket_path); // Counters can be scraped while simulation runs and until program ends
+    }
+    if(memory_log_file != NULL){
+        open_memory_log(memory_log_file);
+    }
+
+    if(!headless){
+        init_screen();
+        init_threads(simulation_t, print_simulation, NULL, 0, 1, FALSE); // Inıtializing simuleation thread
+    }
+    gettimeofday(&start, NULL); // The start time of room and student threads are stored in start struct
+    struct timespec run_start, run_stop;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    double cpu_start = get_cpu_time();
+    long context_switch_start = get_context_switches();
+
+    if(execution_mode == VIRTUAL_MODE){
+        run_virtual(); // Returns when all students are left
+    }
+    else if(execution_mode == POOL_MODE){
+        run_pool(); // Returns when all students are left
+    }
+    else{
+        if(!seat_release){ // Students free their own seats, so rooms have nothing to do
+            init_threads(rooms_t, room_thread, rooms, room_stride, config.room_number, FALSE); // Initializing room threads
+        }
+        int student_thread_number = init_threads(students_t, student_thread, students, sizeof(student), config.student_number, TRUE); // Initializing student threads
+        if(student_thread_number < config.student_number){ // Stop is requested, students that came leave and others never come
+            close_arrivals(student_thread_number);
+        }
+
+        join_threads(students_t, student_thread_number); // Joining student threads
+
+        sem_wait(&finish_sem); // Program waiting until all students are left.
+
+        for(i = 0 ; i < config.room_number && !seat_release ; i++){
+            sem_post(&rooms_sem[i]); // Rooms always wait for new students even if there is no new student. So, room keepers are woken up and they see that simulation is finished
+        }
+        if(!seat_release){
+            join_threads(rooms_t, config.room_number); // Rooms that are cleaning finish it, so no room stops while it holds a lock
+        }
+    }
+    free(students_t);
+    free(rooms_t);
+    if(memory_log != NULL){
+        close_memory_log();
+    }
+    stop_signals();
+    if(trace_file != NULL){
+        close_trace(); // Remaining events are written, so trace is complete before logs are printed
+    }
+
+    if(simulation_benchmark_mode){ // Results are printed without waiting for user and logs are not printed
+        clock_gettime(CLOCK_MONOTONIC, &run_stop);
+        print_benchmark_result((run_stop.tv_sec - run_start.tv_sec) + (double)(run_stop.tv_nsec - run_start.tv_nsec) / 1000000000, get_cpu_time() - cpu_start, get_context_switches() - context_switch_start);
+        if(stats_file != NULL){
+            dump_latency_histograms(stats_file);
+        }
+        close_metrics_socket();
+        return 0;
+    }
+
+    if(checkpoint_file != NULL){
+        printf("%ld checkpoints are written to %s\n", checkpoint_number, checkpoint_file);
+    }
+    if(headless){
+        printf("Press " COLOR_YELLOW "\033[1mENTER\033[0m" COLOR_RESET " to show logs.\n");
+    }
+    else{
+        join_threads(simulation_t, 1); // Simulation thread draws last frame and returns after all students are left
+        gotoxy(2, 8 + config.room_number * 3);
+        printf("Press " COLOR_YELLOW "\033[1mENTER\033[0m" COLOR_RESET " to show logs.%20s\n", " ");
+    }
+    getchar();
+
+    event e;
+    if(trace_file != NULL){ // Event log is emptied by trace writer, all messages are read back from trace
+        size_t event_number = 0;
+        event* events = map_trace(trace_file, NULL, &event_number);
+        size_t k = 0;
+        for(k = 0 ; k < event_number ; k++){
+            print_event(&events[k]);
+        }
+    }
+    while(take_event(&e)){ // Printing all messages after simulation end
+        print_event(&e);
+    }
+    if(atomic_load(&dropped_event_number) > 0){
+        printf(COLOR_RED " %zu messages are lost because log capacity (%zu) is exceeded!" COLOR_RESET "\n", atomic_load(&dropped_event_number), event_log_capacity);
+    }
+
+    print_latency_summary();
+    printf(" %ld students are left in %.1f s, seat utilization is %.1f%%\n", atomic_load(&left_student_total), finished_time / 1000.0, get_seat_utilization());
+    if(config.library_number > 1){
+        printf(" %ld students are sent to another library because their library was full\n", get_sent_student_number());
+    }
+    if(stats_file != NULL){
+        dump_latency_histograms(stats_file);
+    }
+    close_metrics_socket();
+
+    return 0;
+}
+
+/*
+    Reads command line arguments
+    Parameters can be given as --name value or --name=value. Configuration file is read when --config option is seen, so options after it override file
+    argc: Argument number
+    argv: Arguments
+*/
+void parse_arguments(int argc, char** argv){
+
+    int i = 0;
+    for(i = 1 ; i < argc ; i++){
+
+        char* option = argv[i];
+        if(strcmp(option, "--pool") == 0){
+            execution_mode = POOL_MODE;
+            continue;
+        }
+        if(strcmp(option, "--virtual") == 0){
+            execution_mode = VIRTUAL_MODE;
+            continue;
+        }
+        if(strcmp(option, "--headless") == 0){
+            headless = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--bench") == 0){
+            simulation_benchmark_mode = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--measure-locks") == 0){
+            measure_locks = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--bench-scan") == 0){
+            scan_benchmark_mode = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--bench-admission") == 0){
+            benchmark_mode = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--bench-room-scan") == 0){
+            room_scan_benchmark_mode = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--linear-selection") == 0){
+            linear_selection = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--audit-index") == 0){
+            audit_index = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--seat-release") == 0){
+            seat_release = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--endless") == 0){
+            endless_mode = TRUE;
+            continue;
+        }
+        if(strcmp(option, "--help") == 0 || strcmp(option, "-h") == 0){
+            print_usage(argv[0]);
+            exit(0);
+        }
+        if(strncmp(option, "--", 2) != 0){
+            printf("Unknown argument: %s\n", option);
+            print_usage(argv[0]);
+            exit(1);
+        }
+
+        char name[64];
+        char* value = strchr(option, '=');
+        size_t length = value != NULL ? (size_t)(value - option - 2) : strlen(option + 2);
+        if(length >= sizeof(name)){
+            length = sizeof(name) - 1;
+        }
+        memcpy(name, option + 2, length);
+        name[length] = '\0';
+        if(value != NULL){
+            value += 1;
+        }
+        else if(i + 1 < argc){
+            value = argv[++i];
+        }
+        else{
+            printf("Missing value of option: %s\n", option);
+            exit(1);
+        }
+
+        if(strcmp(name, "config") == 0){
+            load_config_file(value);
+            continue;
+        }
+        if(strcmp(name, "stats-file") == 0){
+            stats_file = value;
+            continue;
+        }
+        if(strcmp(name, "trace") == 0){
+            trace_file = value;
+            continue;
+        }
+        if(strcmp(name, "placement") == 0){
+            if(!set_placement(value)){
+                exit(1);
+            }
+            continue;
+        }
+        if(strcmp(name, "checkpoint") == 0){
+            checkpoint_file = value;
+            continue;
+        }
+        if(strcmp(name, "resume") == 0){
+            resume_file = value;
+            continue;
+        }
+        if(strcmp(name, "metrics-socket") == 0){
+            metrics_socket_path = value;
+            continue;
+        }
+        if(strcmp(name, "memory-log") == 0){
+            memory_log_file = value;
+            continue;
+        }
+        if(strcmp(name, "replay") == 0){
+            replay_file = value;
+            continue;
+        }
+        if(strcmp(name, "analyze") == 0){
+            analysis_file = value;
+            continue;
+        }
+        if(strcmp(name, "arrival") == 0){
+            if(strcmp(value, "uniform") != 0 && strcmp(value, "poisson") != 0 && strcmp(value, "bursty") != 0){
+                printf("Invalid arrival distribution: %s\n", value);
+                exit(1);
+            }
+            arrival_distribution = value;
+            continue;
+        }
+        if(strcmp(name, "workload") == 0){
+            workload_file = value;
+            continue;
+        }
+        if(strcmp(name, "arrival-trace") == 0){
+            arrival_distribution = "trace";
+            arrival_trace_file = value;
+            continue;
+        }
+        if(strcmp(name, "bench-format") == 0){
+            if(strcmp(value, "csv") != 0 && strcmp(value, "json") != 0){
+                printf("Invalid benchmark format: %s\n", value);
+                exit(1);
+            }
+            benchmark_format = value;
+            continue;
+        }
+
+        char* c = name;
+        for(c = name ; *c != '\0' ; c++){ // Options use '-' but parameter names use '_'
+            if(*c == '-'){
+                *c = '_';
+            }
+        }
+        if(!set_parameter(name, value)){
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+}
+
+/*
+    Sets placement policy by its name
+    Returns FALSE and prints reason if name is unknown or another policy is fixed at compile time
+    name: Name of policy
+*/
+BOOL set_placement(const char* name){
+
+    int i = 0;
+    for(i = 0 ; i < (int)(sizeof(placement_names) / sizeof(placement_names[0])) ; i++){
+        if(strcmp(placement_names[i], name) != 0){
+            continue;
+        }
+#ifdef PLACEMENT_POLICY
+        if(i != placement_policy){
+            printf("Placement is fixed to %s when program is compiled\n", placement_names[placement_policy]);
+            return FALSE;
+        }
+#else
+        placement_policy = i;
+#endif
+        return TRUE;
+    }
+
+    printf("Invalid placement: %s\n", name);
+    return FALSE;
+}
+
+/*
+    Sets value of a configuration parameter
+    Returns FALSE and prints reason if parameter is unknown or value is not valid
+    name: Name of parameter
+    value: Value as text
+*/
+BOOL set_parameter(const char* name, const char* value){
+
+    size_t i = 0;
+    for(i = 0 ; i < sizeof(parameters) / sizeof(parameters[0]) ; i++){
+        if(strcmp(parameters[i].name, name) == 0){
+            char* end;
+            long number = strtol(value, &end, 10);
+            if(*value == '\0' || *end != '\0' || number < parameters[i].minimum || number > parameters[i].maximum){
+                printf("Invalid value of %s: %s\n", name, value);
+                return FALSE;
+            }
+            *parameters[i].value = (int)number;
+            return TRUE;
+        }
+    }
+
+    printf("Unknown parameter: %s\n", name);
+    return FALSE;
+}
+
+/*
+    Checks all parameters of a configuration against their limits in parameters table, and seat number that is product of two parameters
+    Returns FALSE if a value could not be set from command line
+    c: Configuration that is checked, for example configuration of a snapshot
+*/
+BOOL is_valid_configuration(const configuration* c){
+
+    size_t i = 0;
+    for(i = 0 ; i < sizeof(parameters) / sizeof(parameters[0]) ; i++){
+        int value = *(const int*)((const char*)c + ((char*)parameters[i].value - (char*)&config)); // Same field of c
+        if(value < parameters[i].minimum || value > parameters[i].maximum){
+            return FALSE;
+        }
+    }
+
+    return (long)c->room_capacity * c->room_number <= INT_MAX && c->room_number >= c->library_number;
+}
+
+/*
+    Reads configuration file. Each line is 'name = value', empty lines and lines that start with '#' are skipped
+    path: Path of configuration file
+*/
+void load_config_file(const char* path){
+
+    FILE* file = fopen(path, "r");
+    if(file == NULL){
+        printf("Configuration file can not be opened: %s\n", path);
+        exit(1);
+    }
+
+    char line[256];
+    int line_number = 0;
+    while(fgets(line, sizeof(line), file) != NULL){
+
+        char name[64];
+        char value[64];
+        line_number += 1;
+        if(sscanf(line, " %63[a-z_] = %63s", name, value) != 2){
+            if(sscanf(line, " %63s", name) == 1 && name[0] != '#'){
+                printf("%s:%d: Invalid line\n", path, line_number);
+                exit(1);
+            }
+            continue;
+        }
+        if(!set_parameter(name, value)){
+            printf("%s:%d: Invalid parameter\n", path, line_number);
+            exit(1);
+        }
+    }
+
+    fclose(file);
+}
+
+/*
+    Prints options and parameters with their current values
+    program: Name of program
+*/
+void print_usage(const char* program){
+
+    size_t i = 0;
+    printf("Usage: %s [--pool | --virtual] [--headless] [--bench [--bench-format csv|json] | --bench-admission | --bench-scan | --bench-room-scan] [--linear-selection | --audit-index] [--placement POLICY] [--seat-release] [--endless] [--measure-locks] [--config FILE] [--stats-file FILE] [--trace FILE] [--checkpoint FILE] [--resume FILE] [--metrics-socket PATH] [--memory-log FILE] [--replay FILE | --analyze FILE] [--arrival uniform|poisson|bursty | --arrival-trace FILE | --workload FILE] [--PARAMETER VALUE]...\n", program);
+    printf("  --pool                          Run students and rooms as tasks of a worker pool\n");
+    printf("  --virtual                       Run students and rooms on a virtual clock as fast as possible, times are virtual miliseconds\n");
+    printf("  --headless                      Do not draw simulation, only logs are printed\n");
+    printf("  --bench                         Run simulation without drawing and user input, then print throughput, latency, lock and CPU results\n");
+    printf("  --bench-format FORMAT           Format of --bench result, csv (default) or json\n");
+    printf("  --measure-locks                 Record hold times of room and index locks, it is enabled by --bench\n");
+    printf("  --bench-admission               Measure admission throughput instead of running simulation\n");
+    printf("  --bench-scan                    Measure time and cache misses of scanning all rooms in arena and pointer layouts\n");
+    printf("  --bench-room-scan               Compare scalar, SSE2 and AVX2 kernels of best room scan\n");
+    printf("  --linear-selection              Select rooms by scanning all rooms instead of using heap index\n");
+    printf("  --audit-index                   Check every room that heap index selects against a scan of all rooms\n");
+    printf("  --placement POLICY              Room of a student: most-full (default), least-full, two-choice or round-robin\n");
+    printf("  --seat-release                  Students leave after their own working time and free their seats, rooms are not released as a whole\n");
+    printf("  --endless                       Students keep coming until run time or SIGINT, student number is number of reused student slots\n");
+    printf("  --config FILE                   Read parameters from FILE (lines of 'name = value')\n");
+    printf("  --stats-file FILE               Write latency histograms to FILE as JSON\n");
+    printf("  --trace FILE                    Stream all events to FILE as binary records while simulation runs\n");
+    printf("  --checkpoint FILE               Write a snapshot of simulation to FILE every checkpoint period without stopping it, only with --pool or --virtual\n");
+    printf("  --resume FILE                   Continue simulation from a snapshot of --checkpoint instead of starting from zero\n");
+    printf("  --metrics-socket PATH           Serve live counters in Prometheus text format on Unix socket PATH\n");
+    printf("  --memory-log FILE               Append resident memory to FILE every memory period of simulation\n");
+    printf("  --replay FILE                   Draw simulation from a trace instead of running it\n");
+    printf("  --analyze FILE                  Print utilization, room usage and latency statistics of a trace\n");
+    printf("  --arrival DISTRIBUTION          Periods between student groups: uniform (default), poisson or bursty, all with same mean\n");
+    printf("  --arrival-trace FILE            Repeat periods between student arrivals of a trace\n");
+    printf("  --workload FILE                 Read arrival times, working times and group sizes of students from a CSV or binary file\n");
+    printf("Parameters:\n");
+    for(i = 0 ; i < sizeof(parameters) / sizeof(parameters[0]) ; i++){
+        char option[64];
+        snprintf(option, sizeof(option), "--%s", parameters[i].name);
+        char* c = option;
+        for(c = option + 2 ; *c != '\0' ; c++){
+            if(*c == '_'){
+                *c = '-';
+            }
+        }
+        printf("  %-31s %s (default %d)\n", option, parameters[i].description, *parameters[i].value);
+    }
+}
+
+/*
+    Allocates a zeroed array from arena. Array starts at a cache line, so arrays that are used by different threads do not share lines
+    Arena memory is never freed one by one, all arrays of simulation live until program ends
+    number: Element number
+    size: Size of one element
+*/
+void* arena_alloc(size_t number, size_t size){
+
+    size_t total = number * size;
+    total = (total + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE; // Next array starts at a cache line too
+    if(total == 0){
+        total = CACHE_LINE_SIZE;
+    }
+
+    if(arena_chunk == NULL || arena_used + total > arena_chunk_size){ // A new chunk is taken, rest of old chunk is not used
+        arena_chunk_size = total > ARENA_CHUNK_SIZE ? total : ARENA_CHUNK_SIZE;
+        arena_chunk = (char*) aligned_alloc(CACHE_LINE_SIZE, arena_chunk_size);
+        if(arena_chunk == NULL){
+            printf("FATAL: MEMORY CAN NOT BE ALLOCATED!!!\n");
+            exit(1);
+        }
+        memset(arena_chunk, 0, arena_chunk_size);
+        arena_used = 0;
+    }
+
+    void* block = arena_chunk + arena_used;
+    arena_used += total;
+
+    return block;
+}
+
+/*
+    Returns room at given index
+    index: Index of room starting from 0
+*/
+room* get_room(int index){
+
+    return (room*)((char*)rooms + (size_t)index * room_stride);
+}
+
+/*
+    Returns library that student waits or works in
+    st: Student
+*/
+library* get_student_library(student* st){
+
+    return &libraries[st->library_number];
+}
+
+/*
+    Returns library that room belongs to
+    rm: Room
+*/
+library* get_room_library(room* rm){
+
+    return &libraries[((long)rm->number * config.library_number - 1) / config.room_number];
+}
+
+/*
+    Initializing room and student arrays with default values
+    Students are one array and rooms are one block with their seats inside, both are taken from arena
+*/
+void init_room_student(void){
+
+    room_stride = sizeof(room) + sizeof(int) * config.room_capacity;
+    room_stride = (room_stride + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    rooms = (room*) arena_alloc(config.room_number, room_stride);
+    room_syncs = (room_sync*) arena_alloc(config.room_number, sizeof(room_sync));
+    students = (student*) arena_alloc(config.student_number, sizeof(student));
+    leaving_order = (atomic_int*) arena_alloc(config.student_number, sizeof(atomic_int));
+
+    int i = 0;
+    for(i = 0 ; i < config.student_number ; i++){
+        students[i].number = i + 1;
+        students[i].state = NOT_ENTERED;
+        students[i].room_number = UNDEFINED;
+        students[i].working_duration = config.student_working_time * 1000; // Parameter is limited, so it fits in int
+    }
+    for(i = 0 ; i < config.room_number ; i++){
+        room* rm = get_room(i);
+        rm->number = i + 1;
+        rm->state = EMPTY;
+        rm->student_number = 0;
+        rm->seated_number = 0;
+        rm->times_used = 0;
+    }
+    init_libraries();
+
+}
+
+/*
+    Divides rooms and students between libraries and initializes their locks, admission queues and handoff queues
+    Rooms of a library are consecutive. Students are given to libraries in turn, so every library has students from start
+*/
+void init_libraries(void){
+
+    int i = 0;
+    int l = 0;
+
+    if(config.room_number < config.library_number){
+        printf("Room number (%d) must be at least library number (%d)\n", config.room_number, config.library_number);
+        exit(1);
+    }
+    if(config.library_number > 1 && execution_mode == THREAD_MODE){
+        printf("Several libraries can only be simulated with --pool or --virtual\n");
+        exit(1);
+    }
+
+    libraries = (library*) arena_alloc(config.library_number, sizeof(library));
+    for(i = 0 ; i < config.student_number ; i++){
+        students[i].library_number = i % config.library_number;
+    }
+    for(l = 0 ; l < config.library_number ; l++){
+        library* lib = &libraries[l];
+        lib->number = l;
+        lib->first_room = (int)((long)l * config.room_number / config.library_number);
+        lib->room_number = (int)((long)(l + 1) * config.room_number / config.library_number) - lib->first_room;
+        sem_init(&lib->index_mutex, 0, 1); // Mutex starts from 1 and first access will be accepted without any sem_post
+        lib->empty_seat_number = config.room_capacity * lib->room_number; // All seats are empty at start. Other students have to wait in queue until any room is empty
+        lib->waiting_capacity = config.student_number / config.library_number + 1; // Queue grows if more students are sent to library
+        lib->waiting_queue = (student**) malloc(sizeof(student*) * lib->waiting_capacity);
+        lib->admission_group = (student**) arena_alloc(config.admission_batch, sizeof(student*));
+        sem_init(&lib->waiting_mutex, 0, 1);
+        lib->handoff_capacity = HANDOFF_CAPACITY;
+        while(config.library_number > 1 && lib->handoff_capacity < (size_t)config.student_number / config.library_number){
+            lib->handoff_capacity *= 2;
+        }
+        lib->handoff_queue = (handoff_slot*) arena_alloc(lib->handoff_capacity, sizeof(handoff_slot));
+        for(i = 0 ; i < (int)lib->handoff_capacity ; i++){
+            atomic_init(&lib->handoff_queue[i].sequence, i);
+        }
+    }
+}
+
+/*
+    Creates stack of free student slots for endless mode. Students are taken in order of their numbers at start
+*/
+void init_student_slots(void){
+
+    int i = 0;
+    free_student_slots = (int*) arena_alloc(config.student_number, sizeof(int));
+    for(i = 0 ; i < config.student_number ; i++){
+        free_student_slots[i] = config.student_number - 1 - i;
+    }
+    free_student_number = config.student_number;
+    sem_init(&free_student_mutex, 0, 1);
+}
+
+/*
+    Takes a student slot that is out of library in endless mode and prepares it for a new student
+    Returns NULL if all students are in library
+*/
+student* take_free_student(void){
+
+    student* st = NULL;
+
+    sem_wait(&free_student_mutex);
+    if(free_student_number > 0){
+        st = &students[free_student_slots[--free_student_number]];
+    }
+    sem_post(&free_student_mutex);
+
+    if(st != NULL){ // New student starts from its home library like first student of slot
+        st->room_number = UNDEFINED;
+        st->starvation_time = LONG_MAX; // Starvation task of previous student of slot can still be scheduled, it does nothing until new student is seated
+        st->library_number = (st->number - 1) % config.library_number;
+    }
+
+    return st;
+}
+
+/*
+    Gives slot of a student that left back to endless arrivals
+    st: Student that left
+*/
+void free_student(student* st){
+
+    sem_wait(&free_student_mutex);
+    free_student_slots[free_student_number++] = st->number - 1;
+    sem_post(&free_student_mutex);
+}
+
+/*
+    Initializing all semaphores
+*/
+void init_semaphores(void){
+
+    int i = 0;
+    rooms_sem = (sem_t*) arena_alloc(config.room_number, sizeof(sem_t));
+    leaving_sem = (sem_t*) arena_alloc(config.student_number, sizeof(sem_t));
+    sem_init(&finish_sem, 0, 0); // Finish semaphore starts from zero because main thread has to wait until last student left
+    for(i = 0 ; i < config.student_number ; i++){
+        sem_init(&leaving_sem[i], 0, 0); // Leaving semaphores start from zero because students have to wait until room sends them
+    }
+    seat_sem = (sem_t*) arena_alloc(config.student_number, sizeof(sem_t));
+    for(i = 0 ; i < config.student_number ; i++){
+        sem_init(&seat_sem[i], 0, 0); // Seat semaphores start from zero because students have to wait until an empty seat is given to them
+    }
+    for(i = 0 ; i < config.room_number ; i++){
+        sem_init(&rooms_sem[i], 0, 0);  // Rooms semaphores starts from zero because room has to wait until it is full
+        sem_init(&room_syncs[i].lock, 0, 1); // Room locks start from 1
+        room_syncs[i].opened_time = NOT_OPENED;
+    }
+}
+
+/*
+    Initializes threads according to given parameters
+    threads: Thread array
+    function: Function that threads will run
+    struct_arr: Parameters that will send to threads, first element of an array. Threads get NULL if it is NULL
+    struct_size: Size of one element of struct_arr in bytes
+    size: Number of threads will be created
+    allow_periods: Indicates threads will be created periodically or directly
+    Returns number of created threads. Periodic threads are students and they are not created anymore after a stop is requested
+*/
+int init_threads(pthread_t* threads, void* function, void* struct_arr, size_t struct_size, int size, int allow_periods){
+
+    int i = 0;
+    for(i = 0 ; i < size ; i++){
+        if(allow_periods && is_stop_requested()){
+            break;
+        }
+        if(allow_periods && workload_data != NULL){
+            wait_workload_arrival(&students[i]); // Student is created at its arrival time in workload
+        }
+        if(struct_arr == NULL){
+            pthread_create(&threads[i], NULL, function, NULL);
+        }
+        else{
+            pthread_create(&threads[i], NULL, function, (char*)struct_arr + (size_t)i * struct_size);
+        }
+        if((i + 1) % config.student_number_period == 0 && allow_periods && workload_data == NULL){
+            usleep(next_arrival_gap());
+        }
+    }
+
+    return i;
+}
+
+/*
+    Joins threads according to given parameters
+    threads: Thread array
+    size: Size of thread array
+*/
+void join_threads(pthread_t* threads, int size){
+
+    int i = 0;
+    for(i = 0 ; i < size ; i++){
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+    Seeds random states and selects arrival distribution
+    Same seed gives same arrivals in all modes, and same whole simulation in virtual mode
+*/
+void init_random(void){
+
+    random_seed = config.seed != 0 ? (uint64_t)config.seed : (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    seed_random(&arrival_random, random_seed, 0);
+
+    if(strcmp(arrival_distribution, "poisson") == 0){
+        next_arrival_gap = poisson_arrival_gap;
+    }
+    else if(strcmp(arrival_distribution, "bursty") == 0){
+        next_arrival_gap = bursty_arrival_gap;
+    }
+    else if(strcmp(arrival_distribution, "trace") == 0){
+        load_arrival_trace(arrival_trace_file);
+        next_arrival_gap = trace_arrival_gap;
+    }
+    else{
+        next_arrival_gap = uniform_arrival_gap;
+    }
+}
+
+/*
+    Seeds a random state with splitmix64, so close seeds and streams give unrelated states
+    state: Random state
+    seed: Seed of run
+    stream: Number of generator in run
+*/
+void seed_random(random_state* state, uint64_t seed, uint64_t stream){
+
+    uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    int i = 0;
+    for(i = 0 ; i < 4 ; i++){
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        state->s[i] = z ^ (z >> 31);
+    }
+}
+
+/*
+    Returns next 64 random bits of xoshiro256**
+    state: Random state
+*/
+uint64_t next_random(random_state* state){
+
+    uint64_t* s = state->s;
+    uint64_t result = s[1] * 5;
+    result = ((result << 7) | (result >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+/*
+    Returns a random number in [0, bound) without division
+    state: Random state
+    bound: Upper limit, it must be positive
+*/
+int random_below(random_state* state, int bound){
+
+    return (int)(((next_random(state) >> 32) * (uint64_t)bound) >> 32);
+}
+
+/*
+    Returns an exponentially distributed random number with mean 1
+    Von Neumann's method uses only uniform numbers and comparisons, so math library is not needed
+    state: Random state
+*/
+double random_exponential(random_state* state){
+
+    double k = 0;
+    while(TRUE){
+        double first = (next_random(state) >> 11) * 0x1.0p-53;
+        double previous = first;
+        int n = 1;
+        while(TRUE){ // Length of decreasing run of uniform numbers
+            double next = (next_random(state) >> 11) * 0x1.0p-53;
+            if(next > previous){
+                break;
+            }
+            previous = next;
+            n += 1;
+        }
+        if(n % 2 == 1){
+            return k + first;
+        }
+        k += 1;
+    }
+}
+
+/*
+    Returns random state of current thread. Each thread gets next stream of seed when it is first called
+*/
+random_state* get_thread_random(void){
+
+    if(!thread_random_seeded){
+        seed_random(&thread_random, random_seed, atomic_fetch_add(&random_stream_number, 1));
+        thread_random_seeded = TRUE;
+    }
+
+    return &thread_random;
+}
+
+/*
+    Returns a period that is uniformly distributed in [0, student_incoming_period) microseconds
+*/
+long uniform_arrival_gap(void){
+
+    return random_below(&arrival_random, config.student_incoming_period);
+}
+
+/*
+    Returns an exponentially distributed period, so students come as a Poisson process with same mean period as uniform arrivals
+*/
+long poisson_arrival_gap(void){
+
+    return (long)(random_exponential(&arrival_random) * config.student_incoming_period / 2);
+}
+
+/*
+    Returns no period inside a burst of BURST_GROUP_NUMBER groups and a long random period after a burst, so mean period is same as uniform arrivals
+*/
+long bursty_arrival_gap(void){
+
+    burst_position = (burst_position + 1) % BURST_GROUP_NUMBER;
+    if(burst_position != 0){
+        return 0;
+    }
+
+    return (long)random_below(&arrival_random, config.student_incoming_period) * BURST_GROUP_NUMBER;
+}
+
+/*
+    Returns next period of arrival trace. Periods are repeated from start if trace has fewer groups
+*/
+long trace_arrival_gap(void){
+
+    long gap = arrival_trace_gaps[arrival_trace_position];
+    arrival_trace_position = (arrival_trace_position + 1) % arrival_trace_gap_number;
+
+    return gap;
+}
+
+/*
+    Reads periods between arrival times of a trace. Students that entered in same milisecond are one group
+    path: Path of trace file
+*/
+void load_arrival_trace(const char* path){
+
+    size_t event_number = 0;
+    size_t k = 0;
+    long last_time = -1;
+    event* events = map_trace(path, NULL, &event_number);
+
+    arrival_trace_gaps = (long*) malloc(sizeof(long) * (event_number + 1));
+    for(k = 0 ; k < event_number ; k++){
+        if(events[k].type != EVENT_ENTERED || events[k].time == last_time){
+            continue;
+        }
+        if(last_time >= 0){
+            arrival_trace_gaps[arrival_trace_gap_number++] = (events[k].time - last_time) * 1000;
+        }
+        last_time = events[k].time;
+    }
+    if(arrival_trace_gap_number == 0){ // All students entered together
+        arrival_trace_gaps[arrival_trace_gap_number++] = 0;
+    }
+
+    unmap_trace(events, event_number);
+}
+
+/*
+    Maps workload file and counts its students, config.student_number is set to this number
+    Rows are parsed again while students arrive, so workload is never copied into memory. Pages that are counted are dropped, and kernel reads them again when they are needed
+    CSV lines are "arrival_time,working_time[,group_size]" in miliseconds, lines that do not start with a digit are skipped
+    path: Path of workload file
+*/
+void open_workload(const char* path){
+
+    struct stat file_stat;
+    long arrival_time = 0;
+    int working_time = 0;
+    int group_size = 0;
+    long student_number = 0;
+    long last_arrival_time = LONG_MIN;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &file_stat) != 0){
+        printf("Workload file can not be opened: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    workload_size = file_stat.st_size;
+    if(workload_size == 0){
+        printf("Workload has no students: %s\n", path);
+        exit(1);
+    }
+    workload_data = (char*) mmap(NULL, workload_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(workload_data == MAP_FAILED){
+        printf("Workload file can not be mapped: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    madvise(workload_data, workload_size, MADV_SEQUENTIAL);
+
+    if(workload_size >= 16 && memcmp(workload_data, WORKLOAD_MAGIC, 8) == 0){
+        int header[2];
+        memcpy(header, workload_data + 8, sizeof(header));
+        if(header[0] != WORKLOAD_VERSION || header[1] != sizeof(workload_record)){
+            printf("Invalid workload file: %s\n", path);
+            exit(1);
+        }
+        workload_binary = TRUE;
+    }
+
+    workload_position = workload_binary ? 16 : 0;
+    workload_line = 1;
+    while(read_workload_row(&arrival_time, &working_time, &group_size)){
+        if(workload_start_time < 0){
+            workload_start_time = arrival_time;
+        }
+        if(arrival_time < last_arrival_time){
+            printf("Workload rows are not sorted by arrival time: %s\n", path);
+            exit(1);
+        }
+        last_arrival_time = arrival_time;
+        student_number += group_size;
+        if(student_number > INT_MAX){
+            printf("Workload has too many students: %s\n", path);
+            exit(1);
+        }
+    }
+    if(student_number == 0){
+        printf("Workload has no students: %s\n", path);
+        exit(1);
+    }
+    config.student_number = (int)student_number;
+
+    madvise(workload_data, workload_size, MADV_DONTNEED);
+    workload_position = workload_binary ? 16 : 0;
+    workload_line = 1;
+}
+
+/*
+    Parses next row of workload and moves to following row
+    Returns FALSE at end of workload. Program exits if row is not valid
+    arrival_time: Arrival time of row is written here
+    working_time: Working time of row is written here
+    group_size: Student number of row is written here
+*/
+BOOL read_workload_row(long* arrival_time, int* working_time, int* group_size){
+
+    if(workload_binary){
+        if(workload_position + sizeof(workload_record) > workload_size){
+            return FALSE;
+        }
+        workload_record record;
+        memcpy(&record, workload_data + workload_position, sizeof(record));
+        workload_position += sizeof(record);
+        if(record.working_time < 0 || record.working_time > MAX_WORKING_TIME || record.group_size < 0){
+            printf("Invalid workload record at byte %zu\n", workload_position - sizeof(record));
+            exit(1);
+        }
+        *arrival_time = (long)record.arrival_time;
+        *working_time = record.working_time;
+        *group_size = record.group_size;
+        return TRUE;
+    }
+
+    char* end = workload_data + workload_size;
+    while(workload_position < workload_size){
+        char* line = workload_data + workload_position;
+        char* line_end = memchr(line, '\n', end - line);
+        if(line_end == NULL){
+            line_end = end;
+        }
+        workload_position = line_end - workload_data + 1;
+        workload_line += 1;
+
+        char* c = line;
+        while(c < line_end && (*c == ' ' || *c == '\t')){
+            c++;
+        }
+        if(c == line_end || *c < '0' || *c > '9'){ // Empty line, comment or header
+            continue;
+        }
+
+        long values[3] = { 0, 0, 1 };
+        int value_number = 0;
+        while(value_number < 3 && parse_workload_number(&c, line_end, &values[value_number])){
+            value_number += 1;
+            while(c < line_end && (*c == ' ' || *c == '\t' || *c == '\r')){
+                c++;
+            }
+            if(c < line_end && *c == ','){
+                c++;
+            }
+        }
+        if(value_number < 2 || c != line_end || values[1] > MAX_WORKING_TIME || values[2] > INT_MAX){
+            printf("Invalid workload line %zu\n", workload_line - 1);
+            exit(1);
+        }
+        *arrival_time = values[0];
+        *working_time = (int)values[1];
+        *group_size = (int)values[2];
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+    Parses a decimal number of a CSV workload line. Mapped file has no terminating zero, so strtol can not be used
+    Returns FALSE if there is no number
+    c: Current character, it is moved after number
+    end: End of line
+    value: Number is written here
+*/
+BOOL parse_workload_number(char** c, char* end, long* value){
+
+    char* p = *c;
+    long number = 0;
+
+    while(p < end && (*p == ' ' || *p == '\t')){
+        p++;
+    }
+    if(p == end || *p < '0' || *p > '9'){
+        return FALSE;
+    }
+    while(p < end && *p >= '0' && *p <= '9'){
+        if(number > (LONG_MAX - 9) / 10){
+            return FALSE;
+        }
+        number = number * 10 + (*p - '0');
+        p++;
+    }
+    *c = p;
+    *value = number;
+
+    return TRUE;
+}
+
+/*
+    Returns TRUE and arrival time of next student of workload in miliseconds since start, FALSE if all students have arrived
+    arrival_time: Arrival time is written here
+*/
+BOOL peek_workload_arrival(long* arrival_time){
+
+    long row_time = 0;
+    while(workload_remaining == 0){
+        if(!read_workload_row(&row_time, &workload_working_time, &workload_remaining)){
+            return FALSE;
+        }
+        workload_arrival_time = row_time - workload_start_time;
+    }
+    if(workload_position - workload_dropped >= 2 * WORKLOAD_WINDOW_SIZE){ // Parsed rows are not read again
+        madvise(workload_data + workload_dropped, WORKLOAD_WINDOW_SIZE, MADV_DONTNEED);
+        workload_dropped += WORKLOAD_WINDOW_SIZE;
+    }
+    *arrival_time = workload_arrival_time;
+
+    return TRUE;
+}
+
+/*
+    Gives working time of next student of workload to student
+    st: Student that arrives
+*/
+void take_workload_student(student* st){
+
+    long arrival_time = 0;
+    if(peek_workload_arrival(&arrival_time)){
+        st->working_duration = workload_working_time;
+        workload_remaining -= 1;
+    }
+}
+
+/*
+    Waits until arrival time of next student of workload, then gives its working time to student
+    st: Student that arrives
+*/
+void wait_workload_arrival(student* st){
+
+    long arrival_time = 0;
+    if(peek_workload_arrival(&arrival_time) && arrival_time > get_elapsed_time()){
+        sleep_miliseconds(arrival_time - get_elapsed_time());
+    }
+    take_workload_student(st);
+}
+
+/*
+    Performs operation for a room
+    Run by a thread
+    room_ptr: Room struct that keeps room information
+*/
+void* room_thread(void* room_ptr){
+
+    room* rm = (room*)room_ptr;
+    BOOL full = FALSE;
+
+    while(TRUE){
+
+        if(!full){ // Indicates room is not full and must wait until students fill it
+
+            /*
+                Students announce empty seat number themselves while room is locked, so messages are
+                always in order without waking room keeper for each student. Room keeper is woken up
+                only when room becomes full, that is the only transition that room keeper handles.
+            */
+            sem_wait(&rooms_sem[rm->number - 1]);
+            if(atomic_load(&simulation_finished)){ // Main thread wakes up room keepers after last student left
+                break;
+            }
+            full = TRUE;
+        }
+        else{ // If student number of room reached to config.room_capacity
+
+            mark_room_busy(rm);
+
+            sleep_miliseconds(get_room_working_time(rm)); // Room is sleeping before send student
+
+            release_room(rm); // Changing states of students that are working in this room as leaving
+            full = FALSE;
+
+            sleep(config.room_cleaning_time); // This is not compulsory, only makes simulation looking good. If it is not used we can not see when room is empty because new students directly enter room
+
+            record_cleaning(rm);
+            add_event(EVENT_CLEANED, rm->number, 0, 0);
+            free_seats(get_room_library(rm), config.room_capacity); // Letting waiting students to find empty room to study
+
+        }
+
+    }
+
+    pthread_exit(NULL);
+}
+
+
+/*
+    Performs operation for a student
+    Run by a thread
+    student_ptr: Student struct that keeps student information
+*/
+void* student_thread(void* student_ptr){
+
+    student* st = (student*)student_ptr;
+
+    if(st->state == NOT_ENTERED || st->room_number == UNDEFINED) // Student enters library
+        st->state = WAITING;
+
+    add_event(EVENT_ENTERED, 0, st->number, 0);
+    record_entering(st);
+
+    if(config.admission_batch > 1){ // Student waits in queue and it is seated with a group of students
+        enqueue_student(st);
+        admit_waiting_students(get_student_library(st));
+        sem_wait(&seat_sem[st->number - 1]);
+        if(st->room_number == -1){
+            pthread_exit(NULL);
+        }
+    }
+    else{
+        if(!enter_admission_queue(st)){ // If there is no empty seat students wait in queue, seats are given in order of arrival
+            sem_wait(&seat_sem[st->number - 1]);
+        }
+        st->room_number = select_room(get_student_library(st)); // Student is assigned to most full less used room and a seat is claimed in it
+        if(st->room_number == -1){ // This condition never happening while program is working properly (I tested so many times :) ). But if it comes true, program will crush down
+            /*
+                This condition can be true if and only if all rooms are full and any room gave its seats while it is still full. This is impossible
+            */
+            printf("FATAL: AN UNEXPECTED ERROR HAS OCCURED AND STUDENT %d HAS BEEN TERMINATED!!!\n", st->number);
+            pthread_exit(NULL);
+        }
+
+        if(seat_student(st) && !seat_release){
+            sem_post(&rooms_sem[st->room_number - 1]); // Waking up room keeper because room is full
+        }
+    }
+
+    if(seat_release){ // Student works its own time and frees its seat without waiting for room
+        sleep_miliseconds(st->working_duration);
+        leave_room(st);
+        pthread_exit(NULL);
+    }
+
+
+    struct timespec starvation_deadline;
+    clock_gettime(CLOCK_REALTIME, &starvation_deadline);
+    long deadline_nsec = starvation_deadline.tv_nsec + (long)(st->working_duration + STARVATION_TIME) % 1000 * 1000000;
+    starvation_deadline.tv_sec += (st->working_duration + STARVATION_TIME) / 1000 + deadline_nsec / 1000000000;
+    starvation_deadline.tv_nsec = deadline_nsec % 1000000000;
+    while(sem_timedwait(&leaving_sem[st->number - 1], &starvation_deadline) == -1){ // Student working until room posts leaving semaphore. Room changes state to leaving and posts it if it is full
+
+        if(errno == EINTR){
+            continue;
+        }
+
+        /*
+            If the room never be full, student detects that he worked too much. And leaves the room.
+            Room can send student at the same time when waiting is timed out, so state is checked again while room is locked.
+            Student of a full room waits until room sends it, because room works as long as its longest working student.
+        */
+        if(starve_student(st)){
+            pthread_exit(NULL);
+        }
+        while(sem_wait(&leaving_sem[st->number - 1]) == -1 && errno == EINTR);
+        break;
+    }
+
+    add_event(EVENT_LEAVING, st->room_number, st->number, 0);
+
+    pthread_exit(NULL);
+}
+
+/*
+    Returns room number that placement policy selects in library or -1 if there is no available room
+    Policies are compared with direct branches and their functions are inlined, there is no call through a pointer for each admission. If PLACEMENT_POLICY is defined at compile time, only one policy is left
+    Most full and least full placements take root of room_heap, because heap order follows policy
+    Must be called while index_mutex of library is locked
+    lib: Library whose rooms are searched
+*/
+int get_placement_room(library* lib){
+
+    if(placement_policy == TWO_CHOICE_PLACEMENT){
+        return get_two_choice_room(lib);
+    }
+    if(placement_policy == ROUND_ROBIN_PLACEMENT){
+        return get_round_robin_room(lib);
+    }
+    return get_most_full_room(lib);
+}
+
+/*
+    Returns less full of two random available rooms of library, less used one if they are equally full
+    Rooms are sampled from packed room arrays. If two available rooms are not found in TWO_CHOICE_ATTEMPTS samples, missing candidates are taken from random positions of room_heap, which has only available rooms
+    Must be called while index_mutex of library is locked
+    lib: Library whose rooms are searched
+*/
+int get_two_choice_room(library* lib){
+
+    int i = 0;
+    int found = 0;
+    int best = -1;
+    random_state* random = get_thread_random();
+
+    if(lib->room_heap_size == 0){
+        return -1;
+    }
+    for(i = 0 ; i < TWO_CHOICE_ATTEMPTS && found < 2 ; i++){
+        int index = random_below(random, lib->room_number);
+        if(lib->room_occupancy[index] == -1){
+            continue;
+        }
+        found += 1;
+        if(best == -1 || lib->room_occupancy[index] < lib->room_occupancy[best] ||
+            (lib->room_occupancy[index] == lib->room_occupancy[best] && lib->room_usage[index] < lib->room_usage[best])){
+            best = index;
+        }
+    }
+
+    while(found < 2 && found < lib->room_heap_size){ // Few rooms are available, heap order does not matter because its positions are selected uniformly
+        int index = lib->room_heap[random_below(random, lib->room_heap_size)].index - lib->first_room;
+        if(index == best){
+            continue;
+        }
+        found += 1;
+        if(best == -1 || lib->room_occupancy[index] < lib->room_occupancy[best] ||
+            (lib->room_occupancy[index] == lib->room_occupancy[best] && lib->room_usage[index] < lib->room_usage[best])){
+            best = index;
+        }
+    }
+
+    return lib->first_room + best + 1;
+}
+
+/*
+    Returns first available room of library after room that is selected previously
+    Must be called while index_mutex of library is locked
+    lib: Library whose rooms are searched
+*/
+int get_round_robin_room(library* lib){
+
+    int i = 0;
+
+    if(lib->room_heap_size == 0){
+        return -1;
+    }
+    for(i = 0 ; i < lib->room_number ; i++){
+        int index = (lib->placement_cursor + i) % lib->room_number;
+        if(lib->room_occupancy[index] != -1){
+            lib->placement_cursor = (index + 1) % lib->room_number;
+            return lib->first_room + index + 1;
+        }
+    }
+
+    return -1;
+}
+
+/*
+    Returns most full and less used room number of library
+    Root of room_heap is always the answer, so there is no need to scan rooms. Packed room arrays are scanned instead if linear selection is chosen, and they are compared with root if index is audited
+    Must be called while index_mutex of library is locked
+    lib: Library whose rooms are searched
+*/
+int get_most_full_room(library* lib){
+
+    int index = lib->room_heap_size == 0 ? -1 : lib->room_heap[0].index;
+
+    if(linear_selection || audit_index){
+        int scanned = find_best_room(lib->room_occupancy, lib->room_usage, lib->room_scan_size);
+        if(scanned != -1){
+            scanned += lib->first_room;
+        }
+        if(audit_index && scanned != index){
+            fprintf(stderr, "Room index is corrupted: heap selects room %d but scan selects room %d\n", index + 1, scanned + 1);
+            abort();
+        }
+        index = scanned;
+    }
+
+    return index == -1 ? -1 : get_room(index)->number;
+}
+
+/*
+    Selects most full and less used room and claims a seat in it
+    Index is only a snapshot of rooms, so seat is claimed with compare and swap. If room is changed after last update of index, its key is updated and next room is tried.
+    Returns room number or -1 if there is no available room
+    lib: Library that room is selected in
+*/
+int select_room(library* lib){
+
+    int room_number = -1;
+
+    lock_index(lib);
+    while((room_number = get_placement_room(lib)) != -1){
+        room* rm = get_room(room_number - 1);
+        BOOL claimed = claim_seat(rm);
+        update_room_index(rm);
+        if(claimed){
+            break;
+        }
+    }
+    unlock_index(lib);
+
+    return room_number;
+}
+
+/*
+    Claims a seat in room if room is not full and not busy
+    Returns TRUE if seat is claimed
+    rm: Room that seat will be claimed in
+*/
+BOOL claim_seat(room* rm){
+
+    return claim_seats(rm, 1) == 1;
+}
+
+/*
+    Claims empty seats of room as many as wanted if room is not busy
+    Returns number of claimed seats, it is less than wanted if room does not have enough empty seats
+    rm: Room that seats will be claimed in
+    wanted: Maximum number of seats that will be claimed
+*/
+int claim_seats(room* rm, int wanted){
+
+    int student_number = atomic_load(&rm->student_number);
+
+    while(student_number < config.room_capacity && atomic_load(&rm->state) != BUSY){
+        int claimed = config.room_capacity - student_number < wanted ? config.room_capacity - student_number : wanted;
+        if(atomic_compare_exchange_weak(&rm->student_number, &student_number, student_number + claimed)){
+            return claimed;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Selects rooms of a group of students with locking index once
+    With most full placement, seats of most full less used room are claimed together until it is full, then next room is selected, because a room stays most full while seats are claimed in it
+    Other policies can select another room after each seat, so they claim one seat for each selection. Students are placed in same rooms as they would be if they were admitted one by one with all policies
+    Students of same room are next to each other in group. Room number of a student is -1 if there is no available room for it
+    Returns number of students that have a room
+    lib: Library that rooms are selected in
+    group: Students that will be seated
+    size: Number of students in group
+*/
+int select_rooms(library* lib, student** group, int size){
+
+    int i = 0;
+    int j = 0;
+    int selected = 0;
+    int room_number = -1;
+
+    lock_index(lib);
+    while(selected < size && (room_number = get_placement_room(lib)) != -1){
+        room* rm = get_room(room_number - 1);
+        int claimed = claim_seats(rm, placement_policy == MOST_FULL_PLACEMENT ? size - selected : 1);
+        update_room_index(rm);
+        for(i = 0 ; i < claimed ; i++){
+            group[selected++]->room_number = room_number;
+        }
+    }
+    unlock_index(lib);
+
+    if(placement_policy != MOST_FULL_PLACEMENT){ // Rooms of other policies can alternate, students are sorted by room number with insertion sort because groups are small
+        for(i = 1 ; i < selected ; i++){
+            student* st = group[i];
+            for(j = i ; j > 0 && group[j - 1]->room_number > st->room_number ; j--){
+                group[j] = group[j - 1];
+            }
+            group[j] = st;
+        }
+    }
+
+    for(i = selected ; i < size ; i++){
+        group[i]->room_number = -1;
+    }
+
+    return selected;
+}
+
+/*
+    Seats a group of students that have empty seats. Each room is locked once for all of its students and room keeper announces once
+    Room keeper is woken up only if room becomes full. Students are woken up in thread mode, their starvation tasks are scheduled in pool and virtual modes
+    lib: Library that gave empty seats to students
+    group: Students that will be seated, an empty seat is already given to each of them
+    size: Number of students in group
+*/
+void admit_students(library* lib, student** group, int size){
+
+    int i = 0;
+    int j = 0;
+
+    select_rooms(lib, group, size);
+    for(i = 0 ; i < size ; i = j){
+        if(group[i]->room_number == -1){ // This can not happen because empty_seat_number is never greater than empty seat number of rooms
+            printf("FATAL: AN UNEXPECTED ERROR HAS OCCURED AND STUDENT %d HAS BEEN TERMINATED!!!\n", group[i]->number);
+            j = i + 1;
+            if(execution_mode == THREAD_MODE){
+                sem_post(&seat_sem[group[i]->number - 1]);
+            }
+            continue;
+        }
+
+        room* rm = get_room(group[i]->room_number - 1);
+        lock_room(rm);
+        for(j = i ; j < size && group[j]->room_number == rm->number ; j++){
+            group[j]->state = WORKING; // Student is assigned to a room and started working
+            record_working(group[j]);
+            add_event(EVENT_WORKING, rm->number, group[j]->number, 0);
+            take_seat(rm, group[j]->number);
+        }
+        BOOL full = announce_room(rm);
+        unlock_room(rm);
+
+        if(execution_mode == THREAD_MODE){
+            for(int k = i ; k < j ; k++){
+                sem_post(&seat_sem[group[k]->number - 1]); // Student starts working
+            }
+            if(full && !seat_release){
+                sem_post(&rooms_sem[rm->number - 1]); // Room keeper wakes up only to make room busy
+            }
+        }
+        else{
+            for(int k = i ; k < j ; k++){
+                if(seat_release){
+                    schedule_task(lib, seat_release_task, group[k], group[k]->working_duration);
+                }
+                else{
+                    group[k]->starvation_time = get_elapsed_time() + group[k]->working_duration + STARVATION_TIME;
+                    schedule_task(lib, starvation_task, group[k], group[k]->working_duration + STARVATION_TIME);
+                }
+            }
+            if(full && !seat_release){
+                mark_room_busy(rm);
+                schedule_task(lib, release_task, rm, get_room_working_time(rm));
+            }
+        }
+    }
+}
+
+/*
+    Adds student to end of waiting queue of its library
+    st: Student that waits for an empty seat
+*/
+void enqueue_student(student* st){
+
+    library* lib = get_student_library(st);
+
+    sem_wait(&lib->waiting_mutex);
+    push_waiting_student(st);
+    sem_post(&lib->waiting_mutex);
+}
+
+/*
+    Gives an empty seat of its library to student directly if there is an empty seat and nobody is waiting before it, otherwise adds student to end of waiting queue
+    Queued student gets a seat from free_seats after all students before it, so waiting time is bounded by arrival order
+    Returns TRUE if student has a seat now
+    st: Student that wants to work
+*/
+BOOL enter_admission_queue(student* st){
+
+    BOOL seated = FALSE;
+    library* lib = get_student_library(st);
+
+    sem_wait(&lib->waiting_mutex);
+    if(lib->waiting_number == 0 && lib->empty_seat_number > 0){
+        lib->empty_seat_number -= 1;
+        lib->admitted_number += 1;
+        seated = TRUE;
+    }
+    else{
+        push_waiting_student(st);
+    }
+    sem_post(&lib->waiting_mutex);
+
+    return seated;
+}
+
+/*
+    Takes empty seats of library without waiting if nobody is waiting in queue
+    Returns number of taken seats
+    lib: Library that seats are taken in
+    wanted: Maximum number of seats that will be taken
+*/
+int take_empty_seats(library* lib, int wanted){
+
+    int taken = 0;
+
+    sem_wait(&lib->waiting_mutex);
+    if(lib->waiting_number == 0){
+        taken = lib->empty_seat_number < wanted ? lib->empty_seat_number : wanted;
+        lib->empty_seat_number -= taken;
+        lib->admitted_number += taken;
+    }
+    sem_post(&lib->waiting_mutex);
+
+    return taken;
+}
+
+/*
+    Makes seats of library empty and gives them to waiting students in order of arrival
+    Waiting students are admitted as groups if admission_batch is greater than 1
+    lib: Library that seats are in
+    number: Number of seats that became empty
+*/
+void free_seats(library* lib, int number){
+
+    sem_wait(&lib->waiting_mutex);
+    lib->empty_seat_number += number;
+    while(config.admission_batch == 1 && lib->empty_seat_number > 0 && lib->waiting_number > 0){
+        give_seat(pop_waiting_student(lib));
+    }
+    sem_post(&lib->waiting_mutex);
+
+    if(config.admission_batch > 1){
+        admit_waiting_students(lib);
+    }
+}
+
+/*
+    Lets student continue after an empty seat is given to it
+    Student thread is waiting on its seat semaphore in thread mode. In pool and virtual modes a task is scheduled to seat student
+    st: Student that has an empty seat
+*/
+void give_seat(student* st){
+
+    if(execution_mode != THREAD_MODE){
+        schedule_task(get_student_library(st), admit_student_task, st, 0);
+    }
+    else{
+        sem_post(&seat_sem[st->number - 1]);
+    }
+}
+
+/*
+    Adds student to end of waiting queue of its library. Queue is doubled if it is full
+    Must be called while waiting_mutex of library is locked
+    st: Student that waits for an empty seat
+*/
+void push_waiting_student(student* st){
+
+    int i = 0;
+    library* lib = get_student_library(st);
+
+    if(lib->waiting_number == lib->waiting_capacity){ // Students are moved to start of a bigger queue
+        student** queue = (student**) malloc(sizeof(student*) * lib->waiting_capacity * 2);
+        for(i = 0 ; i < lib->waiting_number ; i++){
+            queue[i] = lib->waiting_queue[(lib->waiting_head + i) % lib->waiting_capacity];
+        }
+        free(lib->waiting_queue);
+        lib->waiting_queue = queue;
+        lib->waiting_head = 0;
+        lib->waiting_capacity *= 2;
+    }
+
+    st->queued_time = get_monotonic_time();
+    lib->waiting_queue[(lib->waiting_head + lib->waiting_number) % lib->waiting_capacity] = st;
+    lib->waiting_number += 1;
+    if(lib->waiting_number > lib->max_waiting_number){
+        lib->max_waiting_number = lib->waiting_number;
+    }
+    int total = atomic_fetch_add_explicit(&waiting_student_total, 1, memory_order_relaxed) + 1;
+    int max = atomic_load_explicit(&max_waiting_student_total, memory_order_relaxed);
+    while(total > max && !atomic_compare_exchange_weak_explicit(&max_waiting_student_total, &max, total, memory_order_relaxed, memory_order_relaxed));
+}
+
+/*
+    Removes first student of waiting queue and gives an empty seat to it
+    Must be called while waiting_mutex of library is locked. Queue must not be empty and there must be an empty seat
+    Returns student that is removed
+    lib: Library whose queue is used
+*/
+student* pop_waiting_student(library* lib){
+
+    student* st = lib->waiting_queue[lib->waiting_head];
+    lib->waiting_head = (lib->waiting_head + 1) % lib->waiting_capacity;
+    lib->waiting_number -= 1;
+    lib->empty_seat_number -= 1;
+    lib->admitted_number += 1;
+    atomic_fetch_sub_explicit(&waiting_student_total, 1, memory_order_relaxed);
+
+    return st;
+}
+
+/*
+    Copies numbers of waiting students of all libraries in order of queues
+    Returns number of copied students
+    numbers: Student numbers are written here
+    max_number: Maximum number of students that will be copied
+*/
+int copy_waiting_students(int* numbers, int max_number){
+
+    int i = 0;
+    int l = 0;
+    int copied = 0;
+
+    for(l = 0 ; l < config.library_number ; l++){
+        library* lib = &libraries[l];
+        sem_wait(&lib->waiting_mutex);
+        for(i = 0 ; i < lib->waiting_number && copied < max_number ; i++){
+            numbers[copied++] = lib->waiting_queue[(lib->waiting_head + i) % lib->waiting_capacity]->number;
+        }
+        sem_post(&lib->waiting_mutex);
+    }
+
+    return copied;
+}
+
+/*
+    Copies live counters of waiting queues of all libraries. It is cheap enough to be called on every frame
+    Longest length is kept for all libraries together, so it is same with any library number
+    stats: Counters are written here
+*/
+void read_admission_queue(admission_queue_stats* stats){
+
+    int l = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    for(l = 0 ; l < config.library_number ; l++){
+        library* lib = &libraries[l];
+        sem_wait(&lib->waiting_mutex);
+        long age = lib->waiting_number > 0 ? get_monotonic_time() - lib->waiting_queue[lib->waiting_head]->queued_time : 0;
+        stats->length += lib->waiting_number;
+        stats->oldest_age = age > stats->oldest_age ? age : stats->oldest_age;
+        stats->admitted_number += lib->admitted_number;
+        sem_post(&lib->waiting_mutex);
+    }
+    stats->max_length = atomic_load_explicit(&max_waiting_student_total, memory_order_relaxed);
+}
+
+/*
+    Admits waiting students of library in groups of at most admission_batch while there are empty seats
+    If another thread is admitting a group, it returns directly. That thread checks queue again after its group, so no student is left in queue while there is an empty seat
+    lib: Library whose queue is admitted
+*/
+void admit_waiting_students(library* lib){
+
+    int size = 0;
+
+    while(TRUE){
+        sem_wait(&lib->waiting_mutex);
+        if(lib->admitting){
+            sem_post(&lib->waiting_mutex);
+            return;
+        }
+        size = 0;
+        while(size < config.admission_batch && lib->waiting_number > 0 && lib->empty_seat_number > 0){
+            lib->admission_group[size++] = pop_waiting_student(lib);
+        }
+        if(size == 0){
+            sem_post(&lib->waiting_mutex);
+            return;
+        }
+        lib->admitting = TRUE;
+        sem_post(&lib->waiting_mutex);
+
+        admit_students(lib, lib->admission_group, size);
+
+        sem_wait(&lib->waiting_mutex);
+        lib->admitting = FALSE;
+        sem_post(&lib->waiting_mutex);
+    }
+}
+
+/*
+    Seats student in room that a seat is claimed in, then empty seat number is announced
+    Announcement is done while room is locked, so seated numbers of announcements of a room are always in order
+    Returns TRUE if student filled room
+    st: Student that has a claimed seat in room of its room_number
+*/
+BOOL seat_student(student* st){
+
+    room* rm = get_room(st->room_number - 1);
+
+    lock_room(rm);
+    st->state = WORKING; // Student is assigned to a room and started working
+    record_working(st);
+    add_event(EVENT_WORKING, st->room_number, st->number, 0);
+    take_seat(rm, st->number); // Number of this student is added to student number array of assigned room
+    BOOL full = announce_room(rm);
+    unlock_room(rm);
+
+    return full;
+}
+
+/*
+    Places student to first empty seat of room
+    Must be called while room is locked
+    rm: Room that student sits in
+    student_number: Number of student
+*/
+void take_seat(room* rm, int student_number){
+
+    int i = 0;
+    for(i = 0 ; i < config.room_capacity ; i++){
+        if(rm->student_id_arr[i] == 0){
+            rm->student_id_arr[i] = student_number;
+            rm->seated_number += 1;
+            break;
+        }
+    }
+}
+
+/*
+    Locks room before its seats or state is changed
+    Version of room becomes odd, so readers of room know that room is being changed
+    rm: Room that will be changed
+*/
+void lock_room(room* rm){
+
+    sem_wait(&room_syncs[rm->number - 1].lock);
+    atomic_store_explicit(&rm->version, atomic_load_explicit(&rm->version, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // Version is visible before changes of room
+    if(measure_locks){
+        room_syncs[rm->number - 1].locked_time = get_monotonic_time();
+    }
+}
+
+/*
+    Unlocks room after it is changed
+    Version of room becomes even again and changes are published with it
+    rm: Room that is changed
+*/
+void unlock_room(room* rm){
+
+    if(measure_locks){
+        record_latency(&room_lock_histogram, get_monotonic_time() - room_syncs[rm->number - 1].locked_time);
+    }
+    atomic_store_explicit(&rm->version, atomic_load_explicit(&rm->version, memory_order_relaxed) + 1, memory_order_release);
+    sem_post(&room_syncs[rm->number - 1].lock);
+}
+
+/*
+    Locks room selection index of library
+    lib: Library whose index is locked
+*/
+void lock_index(library* lib){
+
+    sem_wait(&lib->index_mutex);
+    if(measure_locks){
+        lib->index_locked_time = get_monotonic_time();
+    }
+}
+
+/*
+    Unlocks room selection index of library
+    lib: Library whose index is unlocked
+*/
+void unlock_index(library* lib){
+
+    if(measure_locks){
+        record_latency(&index_lock_histogram, get_monotonic_time() - lib->index_locked_time);
+    }
+    sem_post(&lib->index_mutex);
+}
+
+/*
+    Copies room without locking it, so readers never block students and room keepers
+    Copy is taken again if room is changed while it is copied
+    rm: Room that will be read
+    snapshot: Copy of room is written here. Its student_id_arr must be given by caller
+*/
+void read_room(room* rm, room_snapshot* snapshot){
+
+    unsigned int version;
+
+    while(TRUE){
+        version = atomic_load_explicit(&rm->version, memory_order_acquire);
+        if(version % 2 == 1){ // Room is being changed
+            sched_yield();
+            continue;
+        }
+        snapshot->state = atomic_load_explicit(&rm->state, memory_order_relaxed);
+        snapshot->seated_number = rm->seated_number;
+        snapshot->times_used = atomic_load_explicit(&rm->times_used, memory_order_relaxed);
+        memcpy(snapshot->student_id_arr, rm->student_id_arr, sizeof(int) * config.room_capacity);
+        atomic_thread_fence(memory_order_acquire); // Copy is done before version is read again
+        if(atomic_load_explicit(&rm->version, memory_order_relaxed) == version){
+            break;
+        }
+    }
+}
+
+/*
+    Removes student from its seat
+    Must be called while room is locked
+    rm: Room that student leaves from
+    student_number: Number of student
+*/
+void leave_seat(room* rm, int student_number){
+
+    int i = 0;
+    for(i = 0 ; i < config.room_capacity ; i++){
+        if(rm->student_id_arr[i] == student_number){
+            rm->student_id_arr[i] = 0;
+            rm->seated_number -= 1;
+            break;
+        }
+    }
+}
+
+/*
+    Sends all students in room and marks room as cleaning
+    Only this room is locked, so students can be assigned to other rooms meanwhile
+    rm: Room that will be released
+*/
+void release_room(room* rm){
+
+    int i = 0;
+
+    lock_room(rm);
+    for(i = 0; i < config.room_capacity ; i++){ // Changing states of students that are working in this room as leaving
+        int id = rm->student_id_arr[i];
+        if(id != 0){
+            record_latency(&room_time_histogram, get_monotonic_time() - students[id - 1].working_time);
+            occupied_seat_time += get_monotonic_time() - students[id - 1].working_time;
+            students[id - 1].state = LEAVING;
+            wake_student(&students[id - 1]); // Waking up student to leave
+            rm->student_id_arr[i] = 0;
+        }
+    }
+    add_event(EVENT_RELEASED, rm->number, 0, rm->seated_number); // Added while room is locked, so it is always between last student and next student of room in event log
+    rm->seated_number = 0;
+    rm->student_number = 0; // Seat number is cleared before state, so a student that sees new state also sees empty seats
+    rm->times_used += 1;
+    rm->state = CLEANING;
+    room_syncs[rm->number - 1].opened_time = NOT_OPENED;
+    room_syncs[rm->number - 1].released_time = get_monotonic_time();
+    unlock_room(rm);
+
+    refresh_room_index(rm); // Room is empty again and it can be selected after cleaning
+}
+
+/*
+    Room keeper opens room if it is empty and announces empty seat number
+    It is called by student that is seated instead of waking room keeper, messages are still sent as room keeper
+    Must be called while room is locked
+    Returns TRUE if room is full
+    rm: Room that a student is seated in
+*/
+BOOL announce_room(room* rm){
+
+    if(rm->state == EMPTY){
+        rm->state = ANNOUNCING; // Room keeper is awaken
+        add_event(EVENT_OPENED, rm->number, 0, 0);
+    }
+    if(room_syncs[rm->number - 1].opened_time == NOT_OPENED){ // First student of this usage
+        room_syncs[rm->number - 1].opened_time = get_monotonic_time();
+    }
+
+    // Room keeper announces left empty seat number
+    add_event(EVENT_ANNOUNCING, rm->number, 0, config.room_capacity - rm->seated_number);
+
+    return rm->seated_number == config.room_capacity;
+}
+
+/*
+    Marks room as busy after it is full, so no student is assigned to it until it is released
+    rm: Room that is full
+*/
+void mark_room_busy(room* rm){
+
+    add_event(EVENT_FULL, rm->number, 0, 0);
+    record_latency(&fill_histogram, get_monotonic_time() - room_syncs[rm->number - 1].opened_time);
+    lock_room(rm);
+    rm->state = BUSY; // Room state is updated as busy
+    unlock_room(rm);
+    refresh_room_index(rm);
+}
+
+/*
+    Returns working time of a full room in miliseconds. Room works until its longest working student is done
+    rm: Room that is full
+*/
+int get_room_working_time(room* rm){
+
+    int i = 0;
+    int working_time = 0;
+
+    lock_room(rm);
+    for(i = 0 ; i < config.room_capacity ; i++){
+        int id = rm->student_id_arr[i];
+        if(id != 0 && students[id - 1].working_duration > working_time){
+            working_time = students[id - 1].working_duration;
+        }
+    }
+    unlock_room(rm);
+
+    return working_time;
+}
+
+/*
+    Student leaves its seat after its own working time and the seat is given to next waiting student
+    Room becomes empty and counts one usage when its last student leaves, there is no release or cleaning of whole room
+    st: Student that worked
+*/
+void leave_room(student* st){
+
+    room* rm = get_room(st->room_number - 1);
+    long now = get_monotonic_time();
+
+    lock_room(rm);
+    record_latency(&room_time_histogram, now - st->working_time);
+    occupied_seat_time += now - st->working_time;
+    leave_seat(rm, st->number);
+    rm->student_number -= 1;
+    st->state = LEAVING;
+    add_event(EVENT_LEAVING, rm->number, st->number, 0); // Added while room is locked, so it is before next student of this seat in event log
+    if(rm->seated_number == 0 && rm->student_number == 0){
+        rm->state = EMPTY;
+        rm->times_used += 1;
+        room_syncs[rm->number - 1].opened_time = NOT_OPENED;
+    }
+    unlock_room(rm);
+    refresh_room_index(rm);
+
+    add_outgoing_student(st);
+    free_seats(get_room_library(rm), 1); // Seat is given to first waiting student
+}
+
+/*
+    Student leaves room because room has not been full for a long time
+    Room can send student at the same time, so state is checked while room is locked
+    Returns TRUE if student is left, FALSE if room has already sent student or room is full and will send student
+    st: Student that waited too much
+*/
+BOOL starve_student(student* st){
+
+    if(st->state != WORKING || st->room_number <= 0){ // Student of a reused slot can be waiting without a room
+        return FALSE;
+    }
+
+    room* rm = get_room(st->room_number - 1);
+
+    lock_room(rm);
+    if(st->state != WORKING || rm->seated_number == config.room_capacity){
+        unlock_room(rm);
+        return FALSE;
+    }
+
+    add_event(EVENT_STARVED, st->room_number, st->number, 0);
+    record_latency(&starvation_histogram, get_monotonic_time() - st->working_time);
+    occupied_seat_time += get_monotonic_time() - st->working_time;
+    leave_seat(rm, st->number);
+    rm->student_number -= 1;
+    st->state = LEAVING;
+    add_outgoing_student(st);
+    unlock_room(rm);
+    refresh_room_index(rm);
+    free_seats(get_room_library(rm), 1); // Room has a free seat again, so it is given to first waiting student
+
+    return TRUE;
+}
+
+/*
+    Lets student leave after its state is changed as leaving by room
+    Student thread is waiting on its leaving semaphore in thread mode. In pool and virtual modes a task is scheduled for student and student is counted as outgoing when task is run
+    st: Student that will leave
+*/
+void wake_student(student* st){
+
+    if(execution_mode != THREAD_MODE){
+        schedule_task(get_student_library(st), leave_task, st, 0);
+    }
+    else{
+        sem_post(&leaving_sem[st->number - 1]);
+        add_outgoing_student(st);
+    }
+}
+
+/*
+    Updates place of room in room selection index with locking index of its library
+    rm: Room that is changed
+*/
+void refresh_room_index(room* rm){
+
+    library* lib = get_room_library(rm);
+
+    lock_index(lib);
+    update_room_index(rm);
+    unlock_index(lib);
+}
+
+/*
+    Measures admission throughput of room selection and room locks without any sleep
+    Each thread behaves like a student that comes again as soon as it is seated, the student that fills a room releases it directly
+    Threads wait in admission queue for an empty seat like student threads
+*/
+void run_admission_benchmark(void){
+
+    pthread_t* benchmark_t = (pthread_t*) malloc(sizeof(pthread_t) * config.student_number);
+    struct timespec bench_start, bench_stop;
+
+    config.library_number = 1; // Benchmark measures locks of one library
+    init_room_student();
+    init_room_index();
+    init_event_log(config.max_message_number);
+    init_semaphores();
+
+    sem_init(&benchmark_start_sem, 0, 0);
+    atomic_store(&benchmark_running, TRUE);
+    init_threads(benchmark_t, admission_benchmark_thread, students, sizeof(student), config.student_number, FALSE);
+    clock_gettime(CLOCK_MONOTONIC, &bench_start);
+    for(int i = 0 ; i < config.student_number ; i++){
+        sem_post(&benchmark_start_sem); // All threads start at the same time
+    }
+    sleep(BENCHMARK_TIME);
+    atomic_store(&benchmark_running, FALSE);
+    for(int i = 0 ; i < config.student_number ; i++){
+        sem_post(&seat_sem[i]); // Waking up threads that wait for an empty seat, so they can see benchmark is finished
+    }
+    join_threads(benchmark_t, config.student_number);
+    clock_gettime(CLOCK_MONOTONIC, &bench_stop);
+    free(benchmark_t);
+
+    double seconds = (bench_stop.tv_sec - bench_start.tv_sec) + (double)(bench_stop.tv_nsec - bench_start.tv_nsec) / 1000000000;
+    long admissions = atomic_load(&benchmark_admission_number);
+    printf("rooms,capacity,students,batch,admissions,seconds,admissions_per_second\n");
+    printf("%d,%d,%d,%d,%ld,%.3f,%.0f\n", config.room_number, config.room_capacity, config.student_number, config.admission_batch, admissions, seconds, admissions / seconds);
+}
+
+/*
+    Measures scanning all rooms like a linear room selection and renderer do
+    Rooms are scanned in arena layout and in pointer layout that keeps every room and its seats in separate allocations behind a pointer array
+    Pointer layout is scanned twice. Rooms are in allocation order first, then in a shuffled order like rooms of a heap that is used for a long time
+    Fastest scan time per room and cache misses per scan are printed as CSV. Cache misses are -1 if hardware counters can not be used
+*/
+void run_scan_benchmark(void){
+
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    long checksum = 0;
+
+    config.library_number = 1;
+    init_room_student();
+    pointer_room** pointer_rooms = (pointer_room**) malloc(sizeof(pointer_room*) * config.room_number);
+    for(i = 0 ; i < config.room_number ; i++){ // Allocated in same order as old init_room_student did
+        pointer_rooms[i] = (pointer_room*) malloc(sizeof(pointer_room));
+        pointer_rooms[i]->number = i + 1;
+        pointer_rooms[i]->state = EMPTY;
+        pointer_rooms[i]->student_number = 0;
+        pointer_rooms[i]->seated_number = 0;
+        pointer_rooms[i]->student_id_arr = (int*) calloc(config.room_capacity, sizeof(int));
+        pointer_rooms[i]->times_used = 0;
+    }
+    for(i = 0 ; i < config.room_number ; i++){ // Same random content in both layouts
+        int used = random_below(get_thread_random(), 100);
+        int seated = random_below(get_thread_random(), config.room_capacity + 1);
+        get_room(i)->times_used = used;
+        get_room(i)->student_number = seated;
+        pointer_rooms[i]->times_used = used;
+        pointer_rooms[i]->student_number = seated;
+        for(j = 0 ; j < seated ; j++){
+            get_room(i)->student_id_arr[j] = j + 1;
+            pointer_rooms[i]->student_id_arr[j] = j + 1;
+        }
+    }
+
+    pointer_room** scattered_rooms = (pointer_room**) malloc(sizeof(pointer_room*) * config.room_number);
+    memcpy(scattered_rooms, pointer_rooms, sizeof(pointer_room*) * config.room_number);
+    for(i = config.room_number - 1 ; i > 0 ; i--){ // Fisher-Yates shuffle
+        j = random_below(get_thread_random(), i + 1);
+        pointer_room* tmp = scattered_rooms[i];
+        scattered_rooms[i] = scattered_rooms[j];
+        scattered_rooms[j] = tmp;
+    }
+
+    const char* layouts[] = { "arena", "pointer", "pointer_scattered" };
+    int counter = open_cache_miss_counter();
+    double fastest[3] = { -1, -1, -1 };
+    long misses[3] = { 0, 0, 0 };
+    for(j = 0 ; j < SCAN_REPEAT_NUMBER ; j++){ // Layouts are scanned one after another and fastest scan is kept, so noise of other processes does not change result
+        for(k = 0 ; k < 3 ; k++){
+            struct timespec scan_start, scan_stop;
+            long first_misses = read_cache_miss_counter(counter);
+            clock_gettime(CLOCK_MONOTONIC, &scan_start);
+            checksum += k == 0 ? scan_arena_rooms() : scan_pointer_rooms(k == 1 ? pointer_rooms : scattered_rooms);
+            clock_gettime(CLOCK_MONOTONIC, &scan_stop);
+            misses[k] += read_cache_miss_counter(counter) - first_misses;
+
+            double nanoseconds = (scan_stop.tv_sec - scan_start.tv_sec) * 1000000000.0 + (scan_stop.tv_nsec - scan_start.tv_nsec);
+            if(fastest[k] < 0 || nanoseconds < fastest[k]){
+                fastest[k] = nanoseconds;
+            }
+        }
+    }
+
+    printf("layout,rooms,capacity,room_bytes,ns_per_room,cache_misses_per_scan\n");
+    for(k = 0 ; k < 3 ; k++){
+        printf("%s,%d,%d,%zu,%.2f,%ld\n", layouts[k], config.room_number, config.room_capacity,
+            k == 0 ? room_stride : sizeof(pointer_room) + sizeof(int) * config.room_capacity,
+            fastest[k] / config.room_number, counter < 0 ? -1 : misses[k] / SCAN_REPEAT_NUMBER);
+    }
+
+    if(checksum == 42){ // Keeps compiler from removing scans
+        printf("\n");
+    }
+    for(i = 0 ; i < config.room_number ; i++){
+        free(pointer_rooms[i]->student_id_arr);
+        free(pointer_rooms[i]);
+    }
+    free(pointer_rooms);
+    free(scattered_rooms);
+    if(counter >= 0){
+        close(counter);
+    }
+}
+
+/*
+    Scans rooms in arena like a linear room selection and renderer do
+    Returns index of most full less used room plus first seats of rooms, so scan can not be removed by compiler
+*/
+long scan_arena_rooms(void){
+
+    int i = 0;
+    int best = -1;
+    long best_key = -1;
+    long checksum = 0;
+
+    for(i = 0 ; i < config.room_number ; i++){
+        room* rm = get_room(i);
+        int state = atomic_load_explicit(&rm->state, memory_order_relaxed);
+        int student_number = atomic_load_explicit(&rm->student_number, memory_order_relaxed);
+        int times_used = atomic_load_explicit(&rm->times_used, memory_order_relaxed);
+        long key = state != BUSY && student_number < config.room_capacity ? (long)student_number * 1048576 - times_used : -1; // Most full less used room has biggest key
+        if(key > best_key){
+            best = i;
+            best_key = key;
+        }
+        checksum += rm->student_id_arr[0]; // Renderer reads seats of every room
+    }
+
+    return checksum + best;
+}
+
+/*
+    Scans rooms in pointer layout with same steps as scan_arena_rooms
+    pointer_rooms: Pointer array of rooms
+*/
+long scan_pointer_rooms(pointer_room** pointer_rooms){
+
+    int i = 0;
+    int best = -1;
+    long best_key = -1;
+    long checksum = 0;
+
+    for(i = 0 ; i < config.room_number ; i++){
+        pointer_room* rm = pointer_rooms[i];
+        int state = atomic_load_explicit(&rm->state, memory_order_relaxed);
+        int student_number = atomic_load_explicit(&rm->student_number, memory_order_relaxed);
+        int times_used = atomic_load_explicit(&rm->times_used, memory_order_relaxed);
+        long key = state != BUSY && student_number < config.room_capacity ? (long)student_number * 1048576 - times_used : -1; // Most full less used room has biggest key
+        if(key > best_key){
+            best = i;
+            best_key = key;
+        }
+        checksum += rm->student_id_arr[0];
+    }
+
+    return checksum + best;
+}
+
+/*
+    Opens hardware counter of cache misses of this thread
+    Returns file descriptor of counter or -1 if counters are not available
+*/
+int open_cache_miss_counter(void){
+
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+/*
+    Returns current value of cache miss counter, -1 if it can not be read
+    counter: File descriptor of counter
+*/
+long read_cache_miss_counter(int counter){
+
+    long value = -1;
+    if(counter < 0 || read(counter, &value, sizeof(value)) != sizeof(value)){
+        return -1;
+    }
+
+    return value;
+}
+
+/*
+    Performs admissions for admission benchmark
+    Run by a thread
+    Thread takes every empty seat it finds up to admission_batch and admits them as a group if admission_batch is greater than 1
+    student_ptr: Student struct that keeps student information
+*/
+void* admission_benchmark_thread(void* student_ptr){
+
+    student* st = (student*)student_ptr;
+
+    sem_wait(&benchmark_start_sem);
+    if(config.admission_batch > 1){
+        admit_benchmark_groups(st);
+        pthread_exit(NULL);
+    }
+    while(TRUE){
+
+        if(!enter_admission_queue(st)){
+            sem_wait(&seat_sem[st->number - 1]);
+        }
+        if(!atomic_load_explicit(&benchmark_running, memory_order_relaxed)){
+            break;
+        }
+
+        int room_number = select_room(get_student_library(st));
+        if(room_number == -1){ // This can not happen because empty_seat_number is never greater than empty seat number of rooms
+            free_seats(get_student_library(st), 1);
+            continue;
+        }
+
+        room* rm = get_room(room_number - 1);
+        lock_room(rm);
+        take_seat(rm, st->number);
+        BOOL full = rm->seated_number == config.room_capacity;
+        unlock_room(rm);
+        atomic_fetch_add_explicit(&benchmark_admission_number, 1, memory_order_relaxed);
+
+        if(full){
+            lock_room(rm);
+            rm->state = BUSY;
+            unlock_room(rm);
+            refresh_room_index(rm);
+            release_room(rm);
+            free_seats(get_room_library(rm), config.room_capacity);
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+    Admission loop of a benchmark thread with batched admission
+    Group members are copies of student, so each of them keeps its own room number
+    st: Student that thread behaves like
+*/
+void admit_benchmark_groups(student* st){
+
+    int i = 0;
+    int j = 0;
+    library* lib = get_student_library(st);
+    student* members = (student*) malloc(sizeof(student) * config.admission_batch);
+    student** group = (student**) malloc(sizeof(student*) * config.admission_batch);
+    for(i = 0 ; i < config.admission_batch ; i++){
+        members[i] = *st;
+        group[i] = &members[i];
+    }
+
+    while(TRUE){
+
+        if(!enter_admission_queue(st)){
+            sem_wait(&seat_sem[st->number - 1]);
+        }
+        if(!atomic_load_explicit(&benchmark_running, memory_order_relaxed)){
+            break;
+        }
+        int size = 1 + take_empty_seats(lib, config.admission_batch - 1); // Other empty seats are taken without waiting
+
+        int selected = select_rooms(lib, group, size);
+        if(selected < size){ // This can not happen because empty_seat_number is never greater than empty seat number of rooms
+            free_seats(lib, size - selected);
+        }
+        for(i = 0 ; i < selected ; i = j){
+            room* rm = get_room(group[i]->room_number - 1);
+            lock_room(rm);
+            for(j = i ; j < selected && group[j]->room_number == rm->number ; j++){
+                take_seat(rm, st->number);
+            }
+            BOOL full = rm->seated_number == config.room_capacity;
+            unlock_room(rm);
+
+            if(full){
+                lock_room(rm);
+                rm->state = BUSY;
+                unlock_room(rm);
+                refresh_room_index(rm);
+                release_room(rm);
+                free_seats(get_room_library(rm), config.room_capacity);
+            }
+        }
+        atomic_fetch_add_explicit(&benchmark_admission_number, selected, memory_order_relaxed);
+    }
+
+    free(members);
+    free(group);
+}
+
+
+/*
+    Prints all data reached from rooms and students arrays.
+    There are too many magical numbers that is used to align values.
+    It is not worth to explain.
+    Frame is drawn into screen buffer and only changed characters are sent to terminal
+    Run by a thread until simulation is finished. A stopped or endless run finishes before student_number students leave, so simulation_finished is checked instead of leaving students
+*/
+void* print_simulation(void){
+
+    BOOL finished = FALSE;
+
+    do{
+
+        finished = atomic_load(&simulation_finished); // Read before drawing, so last frame shows all leaving students
+        draw_simulation(atomic_load(&total_outgoing_student_number));
+        if(!finished){
+            usleep(1000000 / config.frame_rate);
+        }
+    } while(!finished);
+
+    pthread_exit(NULL);
+}
+
+/*
+    Draws one frame of simulation from rooms, waiting queue and leaving order
+    Buffers are allocated in first call and kept for next frames. Admission rate is measured between frames
+    leaving_student_number: Number of leaving students that are drawn
+*/
+void draw_simulation(int leaving_student_number){
+
+    static room_snapshot snapshot;
+    static int* waiting_numbers = NULL;
+    static long last_admitted_number = 0;
+    static long last_frame_time = 0;
+    static double admission_rate = 0;
+    admission_queue_stats queue_stats;
+
+    if(waiting_numbers == NULL){
+        snapshot.student_id_arr = (int*) malloc(sizeof(int) * config.room_capacity);
+        waiting_numbers = (int*) malloc(sizeof(int) * config.student_number);
+        last_frame_time = get_monotonic_time();
+    }
+    clear_screen_buffer();
+    screen_print(window.ws_col / 2 - strlen(PROGRAM_NAME), 0, COLOR_BLUE, PROGRAM_NAME);
+
+    read_admission_queue(&queue_stats);
+    long frame_time = get_monotonic_time();
+    if(frame_time > last_frame_time){
+        admission_rate = (queue_stats.admitted_number - last_admitted_number) * 1000000000.0 / (frame_time - last_frame_time);
+    }
+    last_admitted_number = queue_stats.admitted_number;
+    last_frame_time = frame_time;
+    screen_print(2, 2, COLOR_CYAN, "QUEUE %d (MAX %d)   OLDEST %ld ms   ADMISSIONS %.0f/s",
+        queue_stats.length, queue_stats.max_length, queue_stats.oldest_age / 1000000, admission_rate);
+
+
+    screen_print(3, 3, COLOR_MAGENTA, "ROOM");
+    screen_print(2, 4, COLOR_MAGENTA, "NUMBER");
+    screen_print((config.room_capacity * 7 - 6 )/ 2 + 10, 3, COLOR_MAGENTA, "STUDENT");
+    screen_print((config.room_capacity * 7 - 6 )/ 2 + 10, 4, COLOR_MAGENTA, "NUMBERS");
+    screen_print(config.room_capacity * 7 + 13, 3, COLOR_MAGENTA, "TIMES");
+    screen_print(config.room_capacity * 7 + 13, 4, COLOR_MAGENTA, "USED");
+
+    int i = 0;
+    // Start draw room slots
+    for(i = 0 ; i < config.room_number && 5 + i * 3 <= screen_height ; i++){
+        int j = 0;
+        read_room(get_room(i), &snapshot); // Seats and usage number are drawn from same copy, so they are never from different moments
+        screen_print(4, 6 + i * 3, COLOR_YELLOW, "%2d", i + 1);
+        screen_print(config.room_capacity * 7 + 15, 6 + i * 3, COLOR_YELLOW, "%d", snapshot.times_used);
+        for(j = 0 ; j < config.room_capacity ; j++){
+            screen_print(10 + j * 7, 5 + i * 3, COLOR_GREEN, "________");
+            screen_print(10 + j * 7, 6 + i * 3, COLOR_GREEN, "|      |");
+            screen_print(10 + j * 7, 7 + i * 3, COLOR_GREEN, "‾‾‾‾‾‾‾‾");
+        }
+
+        // Fill room slots
+        for(j = 0 ; j < config.room_capacity ; j++){
+            if(snapshot.student_id_arr[j] != 0){
+                screen_print(13 + j * 7, 6 + i * 3, COLOR_RESET, "%d", snapshot.student_id_arr[j]);
+            }
+        }
+    }
+    // End draw room slots
+
+    //Start list waiting students
+    int student_num_per_line = config.student_number / config.room_number;
+    if(student_num_per_line < 1){ // More rooms than students
+        student_num_per_line = 1;
+    }
+    screen_print(config.room_capacity * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 3, COLOR_MAGENTA, "STUDENTS");
+    screen_print(config.room_capacity * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 4, COLOR_MAGENTA, "WAITING");
+    int line = 0;
+    int count = 0;
+    int waiting_number_shown = copy_waiting_students(waiting_numbers, (screen_height - 5) * student_num_per_line); // Students that do not fit in screen are not copied
+    for(i = 0 ; i < waiting_number_shown ; i++){ // Students are listed in order of queue, first one gets next empty seat
+
+        screen_print(config.room_capacity * 7 + 18 + 5 + count * 4, line + 6, COLOR_RED, "%d ", waiting_numbers[i]);
+        count += 1;
+
+        if(count == student_num_per_line){
+            line += 1;
+            count = 0;
+        }
+    }
+    //End list waiting students
+
+    //Start list leaving students
+    screen_print(config.room_capacity * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 10 + config.student_number / student_num_per_line, COLOR_MAGENTA, "STUDENTS");
+    screen_print(config.room_capacity * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 11 + config.student_number / student_num_per_line, COLOR_MAGENTA, "LEAVING");
+    count = 0;
+    line = 0;
+    for(i = 0 ; i < leaving_student_number && line + 13 + config.student_number / student_num_per_line <= screen_height ; i++){
+
+        int number = atomic_load(&leaving_order[i]);
+        if(number == 0){ // Student is counted but its number is still being written
+            break;
+        }
+        screen_print(config.room_capacity * 7 + 18 + 5 + count * 4, line + 13 + config.student_number / student_num_per_line, COLOR_RED, "%d ", number);
+        count += 1;
+
+        if(count == student_num_per_line){
+            line += 1;
+            count = 0;
+        }
+    }
+    //End list leaving students
+
+    screen_print(2, 8 + config.room_number * 3, COLOR_RESET, "Logs will be available after simulation end.");
+
+    flush_screen();
+}
+
+/*
+    Allocates screen buffers according to terminal size
+    Terminal content is unknown at start, so first frame sends all characters
+*/
+void init_screen(void){
+
+    screen_width = window.ws_col > 0 ? window.ws_col : 110; // Output is not a terminal, default size is used
+    screen_height = window.ws_row > 0 ? window.ws_row : 45;
+    front_screen = (cell*) calloc((size_t)screen_width * screen_height, sizeof(cell));
+    back_screen = (cell*) calloc((size_t)screen_width * screen_height, sizeof(cell));
+    screen_output = (char*) malloc((size_t)screen_width * screen_height * 32 + 64); // Enough for a cursor move, a color and a character per cell
+
+    printf("\033[H\033[J");
+    fflush(stdout);
+}
+
+/*
+    Fills screen buffer with spaces before a frame is drawn
+*/
+void clear_screen_buffer(void){
+
+    int i = 0;
+    for(i = 0 ; i < screen_width * screen_height ; i++){
+        strcpy(back_screen[i].text, " ");
+        back_screen[i].color = COLOR_RESET;
+    }
+}
+
+/*
+    Writes formatted text to screen buffer. Characters that are out of screen are skipped
+    x: Column of first character starting from 1 like gotoxy
+    y: Row starting from 1 like gotoxy
+    color: One of COLOR_* values
+    format: printf format of text
+*/
+void screen_print(int x, int y, const char* color, const char* format, ...){
+
+    char text[256];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+
+    int row = (y > 0 ? y : 1) - 1;
+    int column = (x > 0 ? x : 1) - 1;
+    if(row >= screen_height){
+        return;
+    }
+
+    char* c = text;
+    while(*c != '\0' && column < screen_width){
+        int length = 1; // Byte number of UTF-8 character
+        if(((unsigned char)*c & 0xE0) == 0xC0){
+            length = 2;
+        }
+        else if(((unsigned char)*c & 0xF0) == 0xE0){
+            length = 3;
+        }
+        cell* target = &back_screen[row * screen_width + column];
+        memcpy(target->text, c, length);
+        target->text[length] = '\0';
+        target->color = color;
+        c += length;
+        column += 1;
+    }
+}
+
+/*
+    Sends characters that are different from terminal with one write call and swaps screen buffers
+    Cursor is moved only if changed characters are not next to each other, color is sent only if it is changed
+*/
+void flush_screen(void){
+
+    int row = 0;
+    int column = 0;
+    int cursor_row = -1;
+    int cursor_column = -1;
+    const char* current_color = NULL;
+    size_t length = 0;
+
+    for(row = 0 ; row < screen_height ; row++){
+        for(column = 0 ; column < screen_width ; column++){
+            cell* next = &back_screen[row * screen_width + column];
+            cell* shown = &front_screen[row * screen_width + column];
+            if(next->color == shown->color && strcmp(next->text, shown->text) == 0){
+                continue;
+            }
+            if(row != cursor_row || column != cursor_column){
+                length += sprintf(screen_output + length, "\033[%d;%dH", row + 1, column + 1);
+            }
+            if(next->color != current_color){
+                length += sprintf(screen_output + length, "%s", next->color);
+                current_color = next->color;
+            }
+            length += sprintf(screen_output + length, "%s", next->text);
+            cursor_row = row;
+            cursor_column = column + 1;
+        }
+    }
+
+    if(length > 0){
+        length += sprintf(screen_output + length, COLOR_RESET);
+        fflush(stdout); // Text that is printed by other threads is sent before frame
+        size_t sent = 0;
+        while(sent < length){ // Terminal can accept a part of a big frame in one write
+            ssize_t written = write(STDOUT_FILENO, screen_output + sent, length - sent);
+            if(written < 0 && errno == EINTR){
+                continue;
+            }
+            if(written <= 0){
+                return; // Frame could not be shown, buffers are not swapped so it is sent again next time
+            }
+            sent += written;
+        }
+    }
+
+    cell* tmp = front_screen;
+    front_screen = back_screen;
+    back_screen = tmp;
+}
+
+/*
+    Allocates event log and marks all slots as free
+    capacity: Maximum number of events that can be kept until they are read
+*/
+void init_event_log(size_t capacity){
+
+    size_t i = 0;
+    event_log = (event_slot*) malloc(sizeof(event_slot) * capacity);
+    event_log_capacity = capacity;
+    for(i = 0 ; i < capacity ; i++){
+        atomic_init(&event_log[i].sequence, i);
+    }
+    atomic_init(&event_log_head, 0);
+    atomic_init(&dropped_event_number, 0);
+    event_log_tail = 0;
+}
+
+/*
+    Adds event to event log without any lock. Many threads can add events at the same time.
+    Returns FALSE and counts event as dropped if event log is full
+    type: One of EVENT_* values
+    room_number: Room number of event, 0 if there is no room
+    student_number: Student number of event, 0 if there is no student
+    value: Extra value of event
+*/
+BOOL add_event(int type, int room_number, int student_number, int value){
+
+    long now = get_elapsed_time();
+    size_t pos = atomic_load_explicit(&event_log_head, memory_order_relaxed);
+    event_slot* slot;
+
+    while(TRUE){
+        slot = &event_log[pos % event_log_capacity];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        long diff = (long)sequence - (long)pos;
+
+        if(diff == 0){ // Slot is free, it is claimed if no other thread claimed it before
+            if(atomic_compare_exchange_weak_explicit(&event_log_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        }
+        else if(diff < 0){ // Slot is still not read, so event log is full
+            atomic_fetch_add_explicit(&dropped_event_number, 1, memory_order_relaxed);
+            return FALSE;
+        }
+        else{ // Another thread claimed this position, trying next position
+            pos = atomic_load_explicit(&event_log_head, memory_order_relaxed);
+        }
+    }
+
+    slot->data.type = type;
+    slot->data.value = value;
+    slot->data.room_number = room_number;
+    slot->data.student_number = student_number;
+    slot->data.time = now;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release); // Publishing event to reader
+
+    return TRUE;
+}
+
+/*
+    Takes oldest event from event log and frees its slot
+    Returns FALSE if there is no written event
+    e: Event is copied to here
+*/
+BOOL take_event(event* e){
+
+    event_slot* slot = &event_log[event_log_tail % event_log_capacity];
+
+    if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != event_log_tail + 1){
+        return FALSE;
+    }
+
+    *e = slot->data;
+    atomic_store_explicit(&slot->sequence, event_log_tail + event_log_capacity, memory_order_release); // Slot can be used again in next round
+    event_log_tail += 1;
+
+    return TRUE;
+}
+
+/*
+    Prints message of event
+    e: Event that will be printed
+*/
+void print_event(event* e){
+
+    switch(e->type){
+        case EVENT_ENTERED:
+            printf(" Student %d has " COLOR_BLUE "\033[1mENTERED\033[0m" COLOR_RESET " into library and started to wait! " COLOR_GREEN "\t%ld ms" COLOR_RESET "\n", e->student_number, e->time);
+            break;
+        case EVENT_WORKING:
+            printf(" Student %d " COLOR_BLUE "\033[1mWORKING\033[0m" COLOR_RESET " in the %d. room! " COLOR_GREEN "\t\t\t\t%ld ms" COLOR_RESET "\n", e->student_number, e->room_number, e->time);
+            break;
+        case EVENT_LEAVING:
+            printf(" Student %d " COLOR_BLUE "\033[1mLEAVING\033[0m" COLOR_RESET " from %d. room! " COLOR_GREEN "\t\t\t\t%ld ms" COLOR_RESET "\n", e->student_number, e->room_number, e->time);
+            break;
+        case EVENT_STARVED:
+            printf(" " COLOR_RED "STARVATION DETECTED " COLOR_RESET "Student %d " COLOR_BLUE "\033[1mLEAVING\033[0m" COLOR_RESET " from %d. room! " COLOR_GREEN "\t\t%ld ms" COLOR_RESET "\n", e->student_number, e->room_number, e->time);
+            break;
+        case EVENT_OPENED:
+            printf(" Room keeper %d has " COLOR_RED "\033[1mOPENED\033[0m" COLOR_RESET " the room! " COLOR_GREEN "\t\t\t\t%ld ms" COLOR_RESET "\n", e->room_number, e->time);
+            break;
+        case EVENT_ANNOUNCING:
+            printf(" Room keeper %d is " COLOR_RED "\033[1mANNOUNCING\033[0m" COLOR_RESET " %d empty seat left! " COLOR_GREEN "\t\t%ld ms" COLOR_RESET "\n", e->room_number, e->value, e->time);
+            break;
+        case EVENT_FULL:
+            printf(" Room %d is " COLOR_RED "\033[1mFULL\033[0m" COLOR_RESET " capacity! " COLOR_GREEN "\t\t\t\t\t%ld ms" COLOR_RESET "\n", e->room_number, e->time);
+            break;
+        case EVENT_RELEASED:
+            printf(" Room keeper %d has " COLOR_RED "\033[1mRELEASED\033[0m" COLOR_RESET " %d students and started cleaning! " COLOR_GREEN "\t%ld ms" COLOR_RESET "\n", e->room_number, e->value, e->time);
+            break;
+        case EVENT_CLEANED:
+            printf(" Room keeper %d has " COLOR_RED "\033[1mCLEANED\033[0m" COLOR_RESET " the room! " COLOR_GREEN "\t\t\t\t%ld ms" COLOR_RESET "\n", e->room_number, e->time);
+            break;
+    }
+}
+
+/*
+    Opens trace file and writes its header. Events are moved from event log to trace file by trace thread, or by main thread in virtual mode
+    path: Path of trace file
+*/
+void open_trace(const char* path){
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(trace_fd < 0){
+        printf("Trace file can not be opened: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    trace_buffer = (char*) malloc(TRACE_BUFFER_SIZE);
+
+    trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.event_size = sizeof(event);
+    header.room_number = config.room_number;
+    header.room_capacity = config.room_capacity;
+    header.student_number = config.student_number;
+    memcpy(trace_buffer, &header, sizeof(header));
+    trace_buffer_used = sizeof(header);
+    flush_trace_buffer();
+
+    if(execution_mode != VIRTUAL_MODE){
+        atomic_store(&trace_running, TRUE);
+        pthread_create(&trace_t, NULL, trace_thread, NULL);
+    }
+}
+
+/*
+    Moves events from event log to trace file while simulation runs
+    Buffer is written when it is full or TRACE_FLUSH_PERIOD is passed, so only last events are lost if program crashes
+    Run by a thread
+*/
+void* trace_thread(void* arg){
+
+    (void)arg;
+
+    while(atomic_load(&trace_running)){
+        lock_simulation(); // Snapshot is not taken while an event is taken from event log
+        write_trace_events();
+        unlock_simulation();
+        if(trace_buffer_used > 0 && get_monotonic_time() - trace_flushed_time >= TRACE_FLUSH_PERIOD * 1000000L){
+            flush_trace_buffer();
+        }
+        usleep(1000);
+    }
+
+    pthread_exit(NULL);
+}
+
+/*
+    Takes all events from event log and appends them to trace buffer
+    Only one thread can call it, because event log has only one reader
+*/
+void write_trace_events(void){
+
+    event e;
+
+    while(take_event(&e)){
+        if(trace_buffer_used + sizeof(event) > TRACE_BUFFER_SIZE){
+            flush_trace_buffer();
+        }
+        memcpy(trace_buffer + trace_buffer_used, &e, sizeof(event));
+        trace_buffer_used += sizeof(event);
+        traced_event_number += 1;
+    }
+}
+
+/*
+    Writes trace buffer to trace file with as few write calls as possible and empties buffer
+*/
+void flush_trace_buffer(void){
+
+    size_t written = 0;
+
+    while(written < trace_buffer_used){
+        ssize_t result = write(trace_fd, trace_buffer + written, trace_buffer_used - written);
+        if(result < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            printf("Trace file can not be written: %s\n", strerror(errno));
+            break;
+        }
+        written += result;
+    }
+    trace_buffer_used = 0;
+    trace_flushed_time = get_monotonic_time();
+}
+
+/*
+    Stops trace thread, writes remaining events and closes trace file
+*/
+void close_trace(void){
+
+    if(execution_mode != VIRTUAL_MODE){
+        atomic_store(&trace_running, FALSE);
+        pthread_join(trace_t, NULL);
+    }
+    write_trace_events();
+    flush_trace_buffer();
+    close(trace_fd);
+    trace_fd = -1;
+    free(trace_buffer);
+}
+
+/*
+    Maps trace file into memory and checks its header and events
+    Returns first event of trace. Program exits if file is not a trace, or if its dimensions or events are out of their ranges
+    path: Path of trace file
+    header: Header of trace is copied here if it is not NULL
+    number: Number of events in trace is written here
+*/
+event* map_trace(const char* path, trace_header* header, size_t* number){
+
+    struct stat file_stat;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &file_stat) != 0){
+        printf("Trace file can not be opened: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    if((size_t)file_stat.st_size < sizeof(trace_header)){
+        printf("Invalid trace file: %s\n", path);
+        exit(1);
+    }
+
+    char* data = (char*) mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        printf("Trace file can not be mapped: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+
+    trace_header* file_header = (trace_header*) data;
+    if(memcmp(file_header->magic, TRACE_MAGIC, sizeof(file_header->magic)) != 0 || file_header->version != TRACE_VERSION || file_header->event_size != sizeof(event)){
+        printf("Invalid trace file: %s\n", path);
+        exit(1);
+    }
+    configuration dimensions = config; // Header sizes rooms and students of replay, so it is checked like parameters of a snapshot
+    dimensions.room_number = file_header->room_number;
+    dimensions.room_capacity = file_header->room_capacity;
+    dimensions.student_number = file_header->student_number;
+    dimensions.library_number = 1;
+    if(!is_valid_configuration(&dimensions)){
+        printf("Invalid trace file: %s\n", path);
+        exit(1);
+    }
+    if(header != NULL){
+        *header = *file_header;
+    }
+    *number = (file_stat.st_size - sizeof(trace_header)) / sizeof(event); // Last event is skipped if program is stopped while it is written
+
+    event* events = (event*)(data + sizeof(trace_header));
+    size_t k = 0;
+    for(k = 0 ; k < *number ; k++){
+        if(!is_valid_trace_event(&events[k], file_header)){
+            printf("Invalid event %zu in trace file: %s\n", k + 1, path);
+            exit(1);
+        }
+    }
+
+    return events;
+}
+
+/*
+    Checks that type of event is one of EVENT_* values, that its room and student are in ranges of trace, and that it has room and student that its type needs
+    Returns FALSE if event can not be replayed
+    e: Event of trace
+    header: Header of trace
+*/
+BOOL is_valid_trace_event(const event* e, const trace_header* header){
+
+    if(e->type < EVENT_ENTERED || e->type > EVENT_CLEANED || e->time < 0
+        || e->room_number < 0 || e->room_number > header->room_number || e->student_number < 0 || e->student_number > header->student_number){
+        return FALSE;
+    }
+
+    switch(e->type){
+        case EVENT_ENTERED:
+            return e->student_number > 0;
+        case EVENT_WORKING:
+        case EVENT_LEAVING:
+        case EVENT_STARVED:
+            return e->student_number > 0 && e->room_number > 0;
+        default: // Events of room keepers
+            return e->room_number > 0;
+    }
+}
+
+/*
+    Unmaps a trace that is mapped by map_trace
+    events: First event of trace
+    number: Number of events in trace
+*/
+void unmap_trace(event* events, size_t number){
+
+    munmap((char*)events - sizeof(trace_header), sizeof(trace_header) + number * sizeof(event));
+}
+
+/*
+    Changes rooms, students and waiting queue like the event did in simulation
+    Latency histograms and seat time are recorded with virtual clock, so virtual_time must be time of event
+    e: Event of trace
+*/
+void apply_trace_event(event* e){
+
+    int i = 0;
+    long now = get_monotonic_time();
+    student* st = e->student_number > 0 ? &students[e->student_number - 1] : NULL;
+    room* rm = e->room_number > 0 ? get_room(e->room_number - 1) : NULL;
+    room_sync* sync = rm != NULL ? &room_syncs[rm->number - 1] : NULL;
+
+    switch(e->type){
+        case EVENT_ENTERED:
+            st->state = WAITING;
+            record_entering(st);
+            enqueue_student(st);
+            break;
+        case EVENT_WORKING:
+            remove_waiting_student(st);
+            st->state = WORKING;
+            st->room_number = rm->number;
+            record_working(st);
+            if(sync->opened_time == NOT_OPENED){ // First student of this usage
+                sync->opened_time = now;
+            }
+            lock_room(rm);
+            take_seat(rm, st->number);
+            rm->student_number += 1;
+            unlock_room(rm);
+            break;
+        case EVENT_OPENED:
+            lock_room(rm);
+            rm->state = ANNOUNCING;
+            unlock_room(rm);
+            break;
+        case EVENT_FULL:
+            record_latency(&fill_histogram, now - sync->opened_time);
+            lock_room(rm);
+            rm->state = BUSY;
+            unlock_room(rm);
+            break;
+        case EVENT_RELEASED:
+            lock_room(rm);
+            for(i = 0 ; i < config.room_capacity ; i++){
+                int id = rm->student_id_arr[i];
+                if(id != 0){
+                    record_latency(&room_time_histogram, now - students[id - 1].working_time);
+                    occupied_seat_time += now - students[id - 1].working_time;
+                    students[id - 1].state = LEAVING;
+                    rm->student_id_arr[i] = 0;
+                }
+            }
+            rm->seated_number = 0;
+            rm->student_number = 0;
+            rm->times_used += 1;
+            rm->state = CLEANING;
+            unlock_room(rm);
+            sync->opened_time = NOT_OPENED;
+            sync->released_time = now;
+            break;
+        case EVENT_CLEANED:
+            record_cleaning(rm);
+            break;
+        case EVENT_STARVED:
+            record_latency(&starvation_histogram, now - st->working_time);
+            occupied_seat_time += now - st->working_time;
+            lock_room(rm);
+            leave_seat(rm, st->number);
+            rm->student_number -= 1;
+            unlock_room(rm);
+            st->state = LEAVING;
+            add_outgoing_student(st);
+            break;
+        case EVENT_LEAVING:
+            if(st->state == WORKING){ // Student of seat release model leaves its seat itself
+                record_latency(&room_time_histogram, now - st->working_time);
+                occupied_seat_time += now - st->working_time;
+                lock_room(rm);
+                leave_seat(rm, st->number);
+                rm->student_number -= 1;
+                if(rm->seated_number == 0 && rm->student_number == 0){
+                    rm->state = EMPTY;
+                    rm->times_used += 1;
+                    sync->opened_time = NOT_OPENED;
+                }
+                unlock_room(rm);
+                st->state = LEAVING;
+            }
+            add_outgoing_student(st);
+            break;
+    }
+}
+
+/*
+    Removes student from waiting queue wherever it is. Student is usually first one, because seats are given in order of arrival
+    st: Student that is seated
+*/
+void remove_waiting_student(student* st){
+
+    int i = 0;
+    int j = 0;
+    library* lib = get_student_library(st);
+
+    sem_wait(&lib->waiting_mutex);
+    for(i = 0 ; i < lib->waiting_number ; i++){
+        if(lib->waiting_queue[(lib->waiting_head + i) % lib->waiting_capacity] != st){
+            continue;
+        }
+        if(i == 0){
+            lib->waiting_head = (lib->waiting_head + 1) % lib->waiting_capacity;
+        }
+        else{
+            for(j = i ; j + 1 < lib->waiting_number ; j++){ // Students after it are moved forward
+                lib->waiting_queue[(lib->waiting_head + j) % lib->waiting_capacity] = lib->waiting_queue[(lib->waiting_head + j + 1) % lib->waiting_capacity];
+            }
+        }
+        lib->waiting_number -= 1;
+        lib->admitted_number += 1;
+        atomic_fetch_sub_explicit(&waiting_student_total, 1, memory_order_relaxed);
+        break;
+    }
+    sem_post(&lib->waiting_mutex);
+}
+
+/*
+    Draws a trace like a running simulation. Each frame shows state of library after all events until time of frame
+    Trace time of a frame is replay_speed times real time of a frame
+    path: Path of trace file
+*/
+void run_replay(const char* path){
+
+    trace_header header;
+    size_t event_number = 0;
+    size_t k = 0;
+    event* events = map_trace(path, &header, &event_number);
+
+    config.room_number = header.room_number;
+    config.room_capacity = header.room_capacity;
+    config.student_number = header.student_number;
+    config.library_number = 1; // Trace does not keep libraries, all rooms are drawn as one library
+    execution_mode = VIRTUAL_MODE; // Clocks follow trace time
+    init_room_student();
+    init_semaphores();
+    ioctl(0, TIOCGWINSZ, &window);
+    init_screen();
+
+    long frame_period = 1000L * config.replay_speed / config.frame_rate;
+    if(frame_period < 1){
+        frame_period = 1;
+    }
+    long frame_time = 0;
+    while(TRUE){
+        while(k < event_number && events[k].time <= frame_time){
+            virtual_time = events[k].time;
+            apply_trace_event(&events[k]);
+            k += 1;
+        }
+        virtual_time = frame_time;
+        draw_simulation(atomic_load(&total_outgoing_student_number));
+        if(k == event_number){
+            break;
+        }
+        frame_time += frame_period;
+        usleep(1000000 / config.frame_rate);
+    }
+
+    gotoxy(2, 8 + config.room_number * 3);
+    printf("Replay of %zu events is finished at %ld ms.%20s\n", event_number, event_number > 0 ? events[event_number - 1].time : 0L, " ");
+    unmap_trace(events, event_number);
+}
+
+/*
+    Replays a trace without drawing and prints seat utilization, distribution of times_used of rooms and latency percentiles
+    Histograms are also written as JSON if --stats-file is given
+    path: Path of trace file
+*/
+void run_trace_analysis(const char* path){
+
+    trace_header header;
+    size_t event_number = 0;
+    size_t k = 0;
+    int i = 0;
+    long type_numbers[EVENT_CLEANED + 1] = { 0 };
+    event* events = map_trace(path, &header, &event_number);
+
+    config.room_number = header.room_number;
+    config.room_capacity = header.room_capacity;
+    config.student_number = header.student_number;
+    config.library_number = 1;
+    execution_mode = VIRTUAL_MODE; // Latencies are measured with trace time
+    init_room_student();
+    init_semaphores();
+
+    for(k = 0 ; k < event_number ; k++){ // Events are checked by map_trace
+        virtual_time = events[k].time;
+        type_numbers[events[k].type] += 1;
+        apply_trace_event(&events[k]);
+    }
+
+    int* times_used = (int*) malloc(sizeof(int) * config.room_number);
+    double mean = 0;
+    double deviation = 0;
+    for(i = 0 ; i < config.room_number ; i++){
+        times_used[i] = get_room(i)->times_used;
+        mean += times_used[i];
+    }
+    mean /= config.room_number;
+    for(i = 0 ; i < config.room_number ; i++){
+        deviation += times_used[i] > mean ? times_used[i] - mean : mean - times_used[i];
+    }
+    deviation /= config.room_number; // Mean absolute deviation, so math library is not needed
+    qsort(times_used, config.room_number, sizeof(int), compare_ints);
+
+    double seat_time = (double)config.room_number * config.room_capacity * virtual_time * 1000000;
+    printf(" Trace %s: %d rooms, %d seats per room, %d students, %zu events, %ld ms\n", path, config.room_number, config.room_capacity, config.student_number, event_number, virtual_time);
+    printf(" Students entered %ld, worked %ld, left %d, starved %ld\n", type_numbers[EVENT_ENTERED], type_numbers[EVENT_WORKING], atomic_load(&total_outgoing_student_number), type_numbers[EVENT_STARVED]);
+    printf(" Seat utilization %.1f%%, rooms were full %ld times\n", seat_time > 0 ? atomic_load(&occupied_seat_time) * 100.0 / seat_time : 0.0, type_numbers[EVENT_FULL]);
+    printf(" Times used of rooms: min %d, p50 %d, p90 %d, max %d, mean %.2f, mean deviation %.2f\n", times_used[0], times_used[config.room_number / 2],
+        times_used[config.room_number * 9 / 10], times_used[config.room_number - 1], mean, deviation);
+    print_latency_summary();
+    if(stats_file != NULL){
+        dump_latency_histograms(stats_file);
+    }
+
+    free(times_used);
+    unmap_trace(events, event_number);
+}
+
+/*
+    Compares two integers for qsort
+*/
+int compare_ints(const void* first, const void* second){
+
+    int a = *(const int*)first;
+    int b = *(const int*)second;
+
+    return (a > b) - (a < b);
+}
+
+/*
+    Returns passed time since start in miliseconds
+    It is time of virtual clock in virtual mode
+*/
+long get_elapsed_time(void){
+
+    if(execution_mode == VIRTUAL_MODE){
+        return virtual_time;
+    }
+
+    struct timeval stop;
+    gettimeofday(&stop, NULL);
+
+    return (long)(((double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec)) * 1000);
+}
+
+/*
+    Sleeps given miliseconds even if it is longer than usleep limit or sleep is interrupted
+    time: Miliseconds to sleep
+*/
+void sleep_miliseconds(long time){
+
+    if(time <= 0){
+        return;
+    }
+    struct timespec remaining = { time / 1000, time % 1000 * 1000000 };
+    while(nanosleep(&remaining, &remaining) == -1 && errno == EINTR);
+}
+
+/*
+    Returns monotonic time in nanoseconds, it is not changed by clock adjustments
+    It is time of virtual clock in virtual mode
+*/
+long get_monotonic_time(void){
+
+    if(execution_mode == VIRTUAL_MODE){
+        return virtual_time * 1000000;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/*
+    Adds a duration to histogram
+    histogram: Histogram of duration
+    value: Duration in nanoseconds
+*/
+void record_latency(histogram* histogram, long value){
+
+    if(value < 0){
+        value = 0;
+    }
+
+    atomic_fetch_add_explicit(&histogram->buckets[get_histogram_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while(value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+/*
+    Returns bucket index of value
+    Values smaller than 2 * HISTOGRAM_SUB_BUCKETS have their own buckets. Bigger values are grouped by their highest bit and HISTOGRAM_SUB_BUCKETS bits after it
+    value: Duration in nanoseconds
+*/
+int get_histogram_bucket(long value){
+
+    if(value < 2 * HISTOGRAM_SUB_BUCKETS){
+        return (int)value;
+    }
+
+    int shift = 63 - __builtin_clzl((unsigned long)value) - 5; // Bits that are dropped, 5 bits are kept after highest bit
+    int bucket = shift * HISTOGRAM_SUB_BUCKETS + (int)(value >> shift);
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+/*
+    Returns biggest value that is counted in bucket
+    bucket: Bucket index
+*/
+long get_bucket_limit(int bucket){
+
+    if(bucket < 2 * HISTOGRAM_SUB_BUCKETS){
+        return bucket;
+    }
+
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    long top = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+/*
+    Returns value that given ratio of recorded values are not bigger than, it is 0 if histogram is empty
+    histogram: Histogram that is searched
+    ratio: Ratio between 0 and 1, 0.99 is 99th percentile
+*/
+long get_percentile(histogram* histogram, double ratio){
+
+    long count = atomic_load(&histogram->count);
+    long max = atomic_load(&histogram->max);
+    long target = (long)(ratio * count + 0.999999);
+    long seen = 0;
+    int i = 0;
+
+    if(target < 1){
+        target = 1;
+    }
+    for(i = 0 ; i < HISTOGRAM_BUCKETS && count > 0 ; i++){
+        seen += atomic_load(&histogram->buckets[i]);
+        if(seen >= target){
+            long limit = get_bucket_limit(i);
+            return limit < max ? limit : max;
+        }
+    }
+
+    return max;
+}
+
+/*
+    Stores entering time of student to measure its waiting time
+    st: Student that entered library
+*/
+void record_entering(student* st){
+
+    st->entered_time = get_monotonic_time();
+    atomic_fetch_add_explicit(&entered_student_number, 1, memory_order_relaxed);
+}
+
+/*
+    Records waiting time of student and stores time that it started working
+    st: Student that started working
+*/
+void record_working(student* st){
+
+    st->working_time = get_monotonic_time();
+    record_latency(&wait_histogram, st->working_time - st->entered_time);
+}
+
+/*
+    Records cleaning time of room before its seats are given again
+    rm: Room that is cleaned
+*/
+void record_cleaning(room* rm){
+
+    record_latency(&cleaning_histogram, get_monotonic_time() - room_syncs[rm->number - 1].released_time);
+}
+
+/*
+    Prints percentiles of all histograms in their units
+*/
+void print_latency_summary(void){
+
+    int i = 0;
+    printf("\n " COLOR_MAGENTA "%-12s %4s %10s %10s %10s %10s %10s %10s" COLOR_RESET "\n", "LATENCY", "UNIT", "COUNT", "MEAN", "P50", "P90", "P99", "MAX");
+    for(i = 0 ; i < histogram_number ; i++){
+        histogram* h = histograms[i];
+        long count = atomic_load(&h->count);
+        double scale = strcmp(h->unit, "ms") == 0 ? 1000000.0 : 1000.0;
+        printf(" %-12s %4s %10ld %10.1f %10.1f %10.1f %10.1f %10.1f\n", h->name, h->unit, count,
+            count > 0 ? atomic_load(&h->sum) / scale / count : 0.0,
+            get_percentile(h, 0.50) / scale, get_percentile(h, 0.90) / scale,
+            get_percentile(h, 0.99) / scale, atomic_load(&h->max) / scale);
+    }
+}
+
+/*
+    Writes all histograms to a JSON file. Values are nanoseconds, each bucket is [lowest value, highest value, count]
+    path: Path of file
+*/
+void dump_latency_histograms(const char* path){
+
+    FILE* file = fopen(path, "w");
+    if(file == NULL){
+        printf("Statistics file can not be opened: %s\n", path);
+        return;
+    }
+
+    int i = 0;
+    fprintf(file, "{\"unit\":\"ns\",\"histograms\":{");
+    for(i = 0 ; i < histogram_number ; i++){
+        histogram* h = histograms[i];
+        int j = 0;
+        BOOL first = TRUE;
+        fprintf(file, "%s\n\"%s\":{\"count\":%ld,\"sum\":%ld,\"p50\":%ld,\"p90\":%ld,\"p99\":%ld,\"max\":%ld,\"buckets\":[",
+            i > 0 ? "," : "", h->name, atomic_load(&h->count), atomic_load(&h->sum),
+            get_percentile(h, 0.50), get_percentile(h, 0.90), get_percentile(h, 0.99), atomic_load(&h->max));
+        for(j = 0 ; j < HISTOGRAM_BUCKETS ; j++){
+            long count = atomic_load(&h->buckets[j]);
+            if(count > 0){
+                fprintf(file, "%s[%ld,%ld,%ld]", first ? "" : ",", j > 0 ? get_bucket_limit(j - 1) + 1 : 0, get_bucket_limit(j), count);
+                first = FALSE;
+            }
+        }
+        fprintf(file, "]}");
+    }
+    fprintf(file, "\n}}\n");
+    fclose(file);
+}
+
+/*
+    Creates metrics socket and starts metrics thread. Old socket file at same path is removed
+    path: Path of Unix socket
+*/
+void open_metrics_socket(const char* path){
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)){
+        printf("Metrics socket path is too long: %s\n", path);
+        exit(1);
+    }
+    strcpy(address.sun_path, path);
+
+    metrics_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if(metrics_fd < 0 || bind(metrics_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(metrics_fd, 16) != 0){
+        printf("Metrics socket can not be opened: %s\n", path);
+        exit(1);
+    }
+    metrics_scraped_time = get_monotonic_time();
+    pthread_create(&metrics_t, NULL, metrics_thread, NULL);
+}
+
+/*
+    Answers each client with current metrics and closes connection
+    A request that starts with GET is answered as HTTP, so Prometheus and curl --unix-socket can scrape it. Other clients only get metrics text
+    Metrics are read from atomic counters and histograms, so scraping never waits for room, index or admission locks
+    Run by a thread
+*/
+void* metrics_thread(void* arg){
+
+    (void)arg;
+    struct timeval timeout = { 0, 100000 }; // Clients that send nothing are answered after 100 ms
+
+    while(TRUE){
+        int client = accept(metrics_fd, NULL, NULL);
+        if(client < 0){
+            if(errno == EINTR || errno == ECONNABORTED){
+                continue;
+            }
+            break;
+        }
+
+        char request[1024];
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ssize_t received = recv(client, request, sizeof(request) - 1, 0);
+        BOOL http = received >= 4 && strncmp(request, "GET ", 4) == 0;
+
+        char* body = NULL;
+        size_t body_size = 0;
+        FILE* output = open_memstream(&body, &body_size);
+        write_metrics(output);
+        fclose(output);
+
+        char header[128];
+        int header_size = http ? snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", body_size) : 0;
+        if(send_all(client, header, header_size)){
+            send_all(client, body, body_size);
+        }
+        free(body);
+        close(client);
+    }
+
+    return NULL;
+}
+
+/*
+    Sends all bytes to a socket. Client can close connection at any time, MSG_NOSIGNAL keeps program running then
+    Returns FALSE if connection is closed
+    fd: Socket
+    data: Bytes that will be sent
+    size: Number of bytes
+*/
+BOOL send_all(int fd, const char* data, size_t size){
+
+    size_t sent = 0;
+    while(sent < size){
+        ssize_t written = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if(written <= 0){
+            return FALSE;
+        }
+        sent += written;
+    }
+
+    return TRUE;
+}
+
+/*
+    Writes current counters in Prometheus text format
+    Rooms are scanned with relaxed loads of their atomic fields. Student states are found from counters, students array is never scanned
+    output: Metrics are written here
+*/
+void write_metrics(FILE* output){
+
+    int i = 0;
+    const char* room_states[] = { "empty", "announcing", "cleaning", "busy" };
+    int room_numbers[4] = { 0, 0, 0, 0 };
+
+    for(i = 0 ; i < config.room_number ; i++){
+        int state = atomic_load_explicit(&get_room(i)->state, memory_order_relaxed);
+        if(state >= EMPTY && state <= BUSY){
+            room_numbers[state] += 1;
+        }
+    }
+    fprintf(output, "# HELP deulibrary_rooms Rooms by state\n# TYPE deulibrary_rooms gauge\n");
+    for(i = 0 ; i < 4 ; i++){
+        fprintf(output, "deulibrary_rooms{state=\"%s\"} %d\n", room_states[i], room_numbers[i]);
+    }
+
+    long entered = atomic_load_explicit(&entered_student_number, memory_order_relaxed);
+    long admitted = atomic_load_explicit(&wait_histogram.count, memory_order_relaxed);
+    long left = atomic_load_explicit(&left_student_total, memory_order_relaxed);
+    admitted = admitted < left ? left : admitted > entered ? entered : admitted; // Counters are read one by one, so they are kept in order
+    fprintf(output, "# HELP deulibrary_students Students by state\n# TYPE deulibrary_students gauge\n");
+    fprintf(output, "deulibrary_students{state=\"not_entered\"} %ld\n", endless_mode ? config.student_number - (entered - left) : config.student_number - entered); // Free slots in endless mode
+    fprintf(output, "deulibrary_students{state=\"waiting\"} %ld\n", entered - admitted);
+    fprintf(output, "deulibrary_students{state=\"working\"} %ld\n", admitted - left);
+    fprintf(output, "deulibrary_students{state=\"left\"} %ld\n", left);
+
+    fprintf(output, "# HELP deulibrary_room_times_used Times that room is emptied\n# TYPE deulibrary_room_times_used counter\n");
+    for(i = 0 ; i < config.room_number ; i++){
+        fprintf(output, "deulibrary_room_times_used{room=\"%d\"} %d\n", i + 1, atomic_load_explicit(&get_room(i)->times_used, memory_order_relaxed));
+    }
+
+    fprintf(output, "# HELP deulibrary_queue_depth Students that wait for an empty seat\n# TYPE deulibrary_queue_depth gauge\n");
+    for(i = 0 ; i < config.library_number ; i++){
+        fprintf(output, "deulibrary_queue_depth{library=\"%d\"} %d\n", i, atomic_load_explicit(&libraries[i].waiting_number, memory_order_relaxed));
+    }
+
+    long now = get_monotonic_time();
+    double rate = now > metrics_scraped_time ? (admitted - metrics_admitted_number) * 1000000000.0 / (now - metrics_scraped_time) : 0.0;
+    metrics_admitted_number = admitted;
+    metrics_scraped_time = now;
+    fprintf(output, "# HELP deulibrary_admissions_total Students that started working\n# TYPE deulibrary_admissions_total counter\n");
+    fprintf(output, "deulibrary_admissions_total %ld\n", admitted);
+    fprintf(output, "# HELP deulibrary_admissions_per_second Admissions per real second since previous scrape\n# TYPE deulibrary_admissions_per_second gauge\n");
+    fprintf(output, "deulibrary_admissions_per_second %.3f\n", rate);
+    fprintf(output, "# HELP deulibrary_starvations_total Students that left a room that has never been full\n# TYPE deulibrary_starvations_total counter\n");
+    fprintf(output, "deulibrary_starvations_total %ld\n", atomic_load_explicit(&starvation_histogram.count, memory_order_relaxed));
+    fprintf(output, "# HELP deulibrary_resident_memory_bytes Resident memory of process\n# TYPE deulibrary_resident_memory_bytes gauge\n");
+    fprintf(output, "deulibrary_resident_memory_bytes %ld\n", get_resident_memory());
+    fprintf(output, "# HELP deulibrary_elapsed_milliseconds Simulation time, it is virtual time in virtual mode\n# TYPE deulibrary_elapsed_milliseconds gauge\n");
+    fprintf(output, "deulibrary_elapsed_milliseconds %ld\n", get_elapsed_time());
+
+    for(i = 0 ; i < histogram_number ; i++){ // Lock histograms are included only if locks are measured
+        histogram* h = histograms[i];
+        fprintf(output, "# HELP deulibrary_%s_seconds Latency of %s\n# TYPE deulibrary_%s_seconds summary\n", h->name, h->name, h->name);
+        fprintf(output, "deulibrary_%s_seconds{quantile=\"0.5\"} %.9f\n", h->name, get_percentile(h, 0.50) / 1000000000.0);
+        fprintf(output, "deulibrary_%s_seconds{quantile=\"0.9\"} %.9f\n", h->name, get_percentile(h, 0.90) / 1000000000.0);
+        fprintf(output, "deulibrary_%s_seconds{quantile=\"0.99\"} %.9f\n", h->name, get_percentile(h, 0.99) / 1000000000.0);
+        fprintf(output, "deulibrary_%s_seconds_sum %.9f\n", h->name, atomic_load_explicit(&h->sum, memory_order_relaxed) / 1000000000.0);
+        fprintf(output, "deulibrary_%s_seconds_count %ld\n", h->name, atomic_load_explicit(&h->count, memory_order_relaxed));
+    }
+}
+
+/*
+    Stops metrics thread and removes socket file
+*/
+void close_metrics_socket(void){
+
+    if(metrics_fd < 0){
+        return;
+    }
+    shutdown(metrics_fd, SHUT_RDWR); // Thread waits in accept and accept fails after shutdown, a client that is being answered is answered completely
+    pthread_join(metrics_t, NULL);
+    close(metrics_fd);
+    unlink(metrics_socket_path);
+    metrics_fd = -1;
+}
+
+/*
+    Blocks SIGINT and SIGTERM and starts a thread that waits for them
+    Must be called before any other thread is created, so all threads take blocked signals from main thread and a signal never interrupts a lock or a sleep of simulation
+*/
+void init_signals(void){
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_create(&signal_t, NULL, signal_thread, NULL);
+}
+
+/*
+    Stops signal thread after simulation is finished and lets signals end program again, for example while program waits for ENTER
+*/
+void stop_signals(void){
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    atomic_store(&simulation_finished, TRUE);
+    pthread_kill(signal_t, SIGTERM); // Signal is blocked, so it only wakes up signal thread
+    pthread_join(signal_t, NULL);
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+}
+
+/*
+    Waits for SIGINT and SIGTERM
+    First signal stops arrivals, so students in library leave and program ends normally. Second signal ends program immediately
+    Run by a thread
+    arg: Not used
+*/
+void* signal_thread(void* arg){
+
+    (void)arg;
+    sigset_t signals;
+    int signal_number = 0;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    while(sigwait(&signals, &signal_number) == 0){
+        if(atomic_load(&simulation_finished)){
+            break;
+        }
+        if(atomic_exchange(&stop_requested, TRUE)){
+            _exit(128 + signal_number);
+        }
+        if(headless){
+            fprintf(stderr, "Students stop coming, program ends after students in library leave\n");
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Opens memory log and writes its header, then starts memory thread in thread and pool modes
+    Virtual clock samples memory itself, because simulation time does not pass in real time
+    path: Path of memory log
+*/
+void open_memory_log(const char* path){
+
+    memory_log = fopen(path, "w");
+    if(memory_log == NULL){
+        printf("Memory log can not be opened: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    fprintf(memory_log, "elapsed_ms,entered_students,left_students,students_in_library,resident_kb\n");
+    if(execution_mode != VIRTUAL_MODE){
+        sem_init(&memory_stop_sem, 0, 0);
+        pthread_create(&memory_t, NULL, memory_thread, NULL);
+    }
+}
+
+/*
+    Writes a memory sample every memory_period miliseconds until simulation ends
+    Run by a thread
+    arg: Not used
+*/
+void* memory_thread(void* arg){
+
+    (void)arg;
+
+    while(TRUE){
+        write_memory_sample();
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += config.memory_period / 1000;
+        deadline.tv_nsec += (config.memory_period % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000){
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if(sem_timedwait(&memory_stop_sem, &deadline) == 0){ // Simulation is finished
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Appends simulation time, student counters and resident memory to memory log
+*/
+void write_memory_sample(void){
+
+    long entered = atomic_load(&entered_student_number);
+    long left = atomic_load(&left_student_total);
+
+    fprintf(memory_log, "%ld,%ld,%ld,%ld,%ld\n", get_elapsed_time(), entered, left, entered - left, get_resident_memory() / 1024);
+    fflush(memory_log);
+}
+
+/*
+    Stops memory thread, writes last sample after simulation end and closes memory log
+*/
+void close_memory_log(void){
+
+    if(execution_mode != VIRTUAL_MODE){
+        sem_post(&memory_stop_sem);
+        pthread_join(memory_t, NULL);
+    }
+    write_memory_sample();
+    fclose(memory_log);
+    memory_log = NULL;
+}
+
+/*
+    Returns resident memory of process in bytes, 0 if it can not be read
+*/
+long get_resident_memory(void){
+
+    long pages = 0;
+    long resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+
+    if(statm == NULL){
+        return 0;
+    }
+    if(fscanf(statm, "%ld %ld", &pages, &resident) != 2){
+        resident = 0;
+    }
+    fclose(statm);
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+    Prepares lock that stops pool workers and trace thread while a snapshot is taken. It is called before any of them starts
+    Lock prefers writer, so checkpoint thread does not wait forever while workers run tasks one after another
+*/
+void init_checkpoint_lock(void){
+
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&checkpoint_lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+}
+
+/*
+    Starts checkpoint thread
+*/
+void start_checkpoints(void){
+
+    sem_init(&checkpoint_stop_sem, 0, 0);
+    pthread_create(&checkpoint_t, NULL, checkpoint_thread, NULL);
+}
+
+/*
+    Stops checkpoint thread and waits until last snapshot is written
+*/
+void stop_checkpoints(void){
+
+    sem_post(&checkpoint_stop_sem);
+    pthread_join(checkpoint_t, NULL);
+    wait_checkpoint(0);
+}
+
+/*
+    Takes a checkpoint every checkpoint period until pool stops
+    Workers are stopped only while process is forked, snapshot is written by child process from its copy of memory
+    Run by a thread
+*/
+void* checkpoint_thread(void* arg){
+
+    (void)arg;
+
+    while(TRUE){
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += config.checkpoint_period / 1000;
+        deadline.tv_nsec += (config.checkpoint_period % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000){
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if(sem_timedwait(&checkpoint_stop_sem, &deadline) == 0){ // Pool is stopped
+            break;
+        }
+
+        pthread_rwlock_wrlock(&checkpoint_lock);
+        take_checkpoint();
+        pthread_rwlock_unlock(&checkpoint_lock);
+    }
+
+    return NULL;
+}
+
+/*
+    Forks a child process that writes simulation to checkpoint file. Child sees memory as it is at fork time and changes of parent are copied on write, so simulation goes on while snapshot is written
+    A period is skipped if previous snapshot is still written
+    Simulation must be consistent while it is called: main thread between tasks in virtual mode, checkpoint lock is held for writing in pool mode
+*/
+void take_checkpoint(void){
+
+    if(!wait_checkpoint(WNOHANG)){
+        return;
+    }
+    snprintf(checkpoint_temporary, sizeof(checkpoint_temporary), "%s.tmp", checkpoint_file);
+
+    pid_t pid = fork();
+    if(pid == 0){ // Only this thread exists in child, so child never takes a lock that another thread may hold
+        _exit(write_snapshot() ? 0 : 1);
+    }
+    if(pid < 0){
+        fprintf(stderr, "Checkpoint process can not be created (%s)\n", strerror(errno));
+        return;
+    }
+    checkpoint_pid = pid;
+}
+
+/*
+    Waits for process that writes snapshot and counts snapshot if it is written
+    Returns FALSE if process is still running
+    options: 0 to wait until process ends, WNOHANG to return directly
+*/
+BOOL wait_checkpoint(int options){
+
+    int status = 0;
+
+    if(checkpoint_pid < 0){
+        return TRUE;
+    }
+    pid_t result = waitpid(checkpoint_pid, &status, options);
+    if(result == 0){
+        return FALSE;
+    }
+    if(result == checkpoint_pid && WIFEXITED(status) && WEXITSTATUS(status) == 0){
+        checkpoint_number += 1;
+    }
+    else{
+        fprintf(stderr, "Checkpoint can not be written: %s\n", checkpoint_file);
+    }
+    checkpoint_pid = -1;
+
+    return TRUE;
+}
+
+/*
+    Marks start of a change of simulation by a pool worker or trace thread. It does nothing if checkpoints are not taken
+*/
+void lock_simulation(void){
+
+    if(checkpoint_file != NULL){
+        pthread_rwlock_rdlock(&checkpoint_lock);
+    }
+}
+
+/*
+    Marks end of a change of simulation by a pool worker or trace thread
+*/
+void unlock_simulation(void){
+
+    if(checkpoint_file != NULL){
+        pthread_rwlock_unlock(&checkpoint_lock);
+    }
+}
+
+/*
+    Writes all simulation state to temporary checkpoint file and renames it to checkpoint file
+    Run by checkpoint child process, so it only reads memory and uses system calls
+    Returns TRUE if snapshot is written
+*/
+BOOL write_snapshot(void){
+
+    int i = 0;
+    int l = 0;
+    size_t k = 0;
+    long queue_number = 0;
+    long now = get_monotonic_time();
+    snapshot_header header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof(snapshot_header);
+    header.config = config;
+    header.seat_release = seat_release;
+    header.workload = workload_data != NULL;
+    header.placement = placement_policy;
+    strncpy(header.arrival_distribution, arrival_distribution, sizeof(header.arrival_distribution) - 1);
+    header.elapsed_time = get_elapsed_time();
+    header.random_seed = random_seed;
+    header.arrival_random = arrival_random;
+    header.task_random = *get_thread_random();
+    header.arrival_trace_position = arrival_trace_position;
+    header.burst_position = burst_position;
+    header.workload_remaining = workload_remaining;
+    header.workload_position = workload_position;
+    header.workload_line = workload_line;
+    header.workload_start_time = workload_start_time;
+    header.workload_arrival_time = workload_arrival_time;
+    header.workload_working_time = workload_working_time;
+    header.arrived_student_number = arrived_student_number;
+    header.entered_student_number = (int)atomic_load(&entered_student_number);
+    header.left_student_number = atomic_load(&total_outgoing_student_number);
+    header.max_waiting_number = atomic_load(&max_waiting_student_total);
+    header.occupied_seat_time = atomic_load(&occupied_seat_time);
+    header.finished_time = finished_time;
+    header.dropped_event_number = atomic_load(&dropped_event_number);
+
+    for(l = 0 ; l < config.library_number ; l++){ // Handoff queues are counted between their read and write positions
+        library* lib = &libraries[l];
+        queue_number += lib->waiting_number + (long)(atomic_load(&lib->handoff_head) - atomic_load(&lib->handoff_tail));
+        header.task_number += lib->task_heap_size;
+    }
+    for(k = event_log_tail ; atomic_load(&event_log[k % event_log_capacity].sequence) == k + 1 ; k++){
+        header.event_number += 1;
+    }
+    set_snapshot_layout(&header, queue_number);
+
+    snapshot_fd = open(checkpoint_temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(snapshot_fd < 0){
+        return FALSE;
+    }
+    char padding[8] = { 0 };
+    write_snapshot_bytes(&header, sizeof(header));
+    write_snapshot_bytes(padding, header.room_offset - sizeof(header));
+
+    for(i = 0 ; i < config.room_number ; i++){
+        room* rm = get_room(i);
+        snapshot_room record = { rm->state, rm->student_number, rm->seated_number, rm->times_used,
+            room_syncs[i].opened_time == NOT_OPENED ? NOT_OPENED : room_syncs[i].opened_time - now, room_syncs[i].released_time - now };
+        write_snapshot_bytes(&record, sizeof(record));
+        write_snapshot_bytes(rm->student_id_arr, sizeof(int) * config.room_capacity);
+        write_snapshot_bytes(padding, header.room_size - sizeof(record) - sizeof(int) * config.room_capacity);
+    }
+    for(i = 0 ; i < config.student_number ; i++){
+        student* st = &students[i];
+        snapshot_student record = { st->state, st->room_number, st->library_number, st->working_duration,
+            st->entered_time - now, st->queued_time - now, st->working_time - now };
+        write_snapshot_bytes(&record, sizeof(record));
+    }
+    for(i = 0 ; i < config.student_number ; i++){
+        int number = atomic_load(&leaving_order[i]);
+        write_snapshot_bytes(&number, sizeof(number));
+    }
+    write_snapshot_bytes(padding, header.library_offset - header.leaving_offset - (long)config.student_number * sizeof(int));
+
+    for(l = 0 ; l < config.library_number ; l++){
+        library* lib = &libraries[l];
+        snapshot_library record = { lib->waiting_number, (int)(atomic_load(&lib->handoff_head) - atomic_load(&lib->handoff_tail)), lib->task_heap_size,
+            lib->max_waiting_number, lib->empty_seat_number, lib->placement_cursor, lib->admitted_number, atomic_load(&lib->received_number), lib->task_sequence };
+        write_snapshot_bytes(&record, sizeof(record));
+    }
+    for(l = 0 ; l < config.library_number ; l++){ // Waiting students are in order of queue, then students in handoff queue
+        library* lib = &libraries[l];
+        for(i = 0 ; i < lib->waiting_number ; i++){
+            write_snapshot_bytes(&lib->waiting_queue[(lib->waiting_head + i) % lib->waiting_capacity]->number, sizeof(int));
+        }
+        for(k = atomic_load(&lib->handoff_tail) ; k < atomic_load(&lib->handoff_head) ; k++){
+            write_snapshot_bytes(&lib->handoff_queue[k & (lib->handoff_capacity - 1)].data->number, sizeof(int));
+        }
+    }
+    write_snapshot_bytes(padding, header.task_offset - header.queue_offset - queue_number * sizeof(int));
+
+    for(l = 0 ; l < config.library_number ; l++){ // Tasks are written in order of heap, so they form a heap again when they are read
+        library* lib = &libraries[l];
+        for(i = 0 ; i < lib->task_heap_size ; i++){
+            task* t = &lib->task_heap[i];
+            snapshot_task record = { t->time, t->sequence, get_task_function(t->function), get_task_argument(t) };
+            write_snapshot_bytes(&record, sizeof(record));
+        }
+    }
+    for(k = 0 ; k < (size_t)header.event_number ; k++){
+        write_snapshot_bytes(&event_log[(event_log_tail + k) % event_log_capacity].data, sizeof(event));
+    }
+    write_snapshot_bytes(padding, header.histogram_offset - header.event_offset - header.event_number * sizeof(event));
+
+    for(i = 0 ; i < (int)(sizeof(histograms) / sizeof(histograms[0])) ; i++){ // Count, sum, maximum and buckets of each histogram
+        histogram* h = histograms[i];
+        long values[3] = { atomic_load(&h->count), atomic_load(&h->sum), atomic_load(&h->max) };
+        write_snapshot_bytes(values, sizeof(values));
+        write_snapshot_bytes(h->buckets, sizeof(h->buckets));
+    }
+
+    BOOL written = flush_snapshot_buffer() && !snapshot_failed && fsync(snapshot_fd) == 0;
+    close(snapshot_fd);
+
+    return written && rename(checkpoint_temporary, checkpoint_file) == 0;
+}
+
+/*
+    Sets room size and offsets of sections of a snapshot from config, task number and event number of header
+    Writer and reader use same layout, so reader can check offsets of a snapshot
+    header: Snapshot header
+    queue_number: Number of students in waiting queues and handoff queues of all libraries
+*/
+void set_snapshot_layout(snapshot_header* header, long queue_number){
+
+    header->room_size = (sizeof(snapshot_room) + sizeof(int) * config.room_capacity + 7) / 8 * 8;
+    header->room_offset = (sizeof(snapshot_header) + 7) / 8 * 8;
+    header->student_offset = header->room_offset + (long)config.room_number * header->room_size;
+    header->leaving_offset = header->student_offset + (long)config.student_number * sizeof(snapshot_student);
+    header->library_offset = header->leaving_offset + ((long)config.student_number * sizeof(int) + 7) / 8 * 8;
+    header->queue_offset = header->library_offset + (long)config.library_number * sizeof(snapshot_library);
+    header->task_offset = header->queue_offset + (queue_number * sizeof(int) + 7) / 8 * 8;
+    header->event_offset = header->task_offset + header->task_number * sizeof(snapshot_task);
+    header->histogram_offset = header->event_offset + (header->event_number * sizeof(event) + 7) / 8 * 8;
+}
+
+/*
+    Adds bytes to snapshot buffer and writes buffer to checkpoint file when it is full
+    data: Bytes that will be written
+    size: Number of bytes
+*/
+void write_snapshot_bytes(const void* data, size_t size){
+
+    const char* bytes = (const char*)data;
+    while(size > 0){
+        size_t part = SNAPSHOT_BUFFER_SIZE - snapshot_buffer_used < size ? SNAPSHOT_BUFFER_SIZE - snapshot_buffer_used : size;
+        memcpy(snapshot_buffer + snapshot_buffer_used, bytes, part);
+        snapshot_buffer_used += part;
+        bytes += part;
+        size -= part;
+        if(snapshot_buffer_used == SNAPSHOT_BUFFER_SIZE && !flush_snapshot_buffer()){
+            snapshot_failed = TRUE;
+        }
+    }
+}
+
+/*
+    Writes snapshot buffer to checkpoint file
+    Returns FALSE if file can not be written
+*/
+BOOL flush_snapshot_buffer(void){
+
+    size_t written = 0;
+    while(written < snapshot_buffer_used){
+        ssize_t result = write(snapshot_fd, snapshot_buffer + written, snapshot_buffer_used - written);
+        if(result < 0 && errno == EINTR){
+            continue;
+        }
+        if(result <= 0){
+            return FALSE;
+        }
+        written += result;
+    }
+    snapshot_buffer_used = 0;
+
+    return TRUE;
+}
+
+/*
+    Returns index of task function in task_functions, -1 if it is unknown
+    function: Function of task
+*/
+int get_task_function(void (*function)(void*)){
+
+    int i = 0;
+    for(i = 0 ; i < (int)(sizeof(task_functions) / sizeof(task_functions[0])) ; i++){
+        if(task_functions[i] == function){
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+    Returns index of student or room that task works on, -1 if task has no argument
+    Release and cleaning tasks work on rooms, other tasks with an argument work on students
+    t: Task
+*/
+int get_task_argument(task* t){
+
+    if(t->argument == NULL){
+        return -1;
+    }
+    if(t->function == release_task || t->function == cleaned_task){
+        return ((room*)t->argument)->number - 1;
+    }
+
+    return ((student*)t->argument)->number - 1;
+}
+
+/*
+    Maps snapshot and takes parameters of simulation from it. Options that do not change simulation, like worker number and frame rate, are kept from command line
+    State is restored later by restore_snapshot, after arrays are created with these parameters
+    path: Path of checkpoint file
+*/
+void load_snapshot(const char* path){
+
+    struct stat file_stat;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &file_stat) != 0){
+        printf("Checkpoint file can not be opened: %s (%s)\n", path, strerror(errno));
+        exit(1);
+    }
+    resume_size = file_stat.st_size;
+    resume_snapshot = resume_size >= sizeof(snapshot_header) ? (snapshot_header*) mmap(NULL, resume_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    snapshot_header* header = resume_snapshot;
+    size_t histogram_size = sizeof(histograms) / sizeof(histograms[0]) * (3 + HISTOGRAM_BUCKETS) * sizeof(long);
+    if(header == MAP_FAILED || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION
+        || header->header_size != sizeof(snapshot_header) || header->histogram_offset < 0 || (size_t)header->histogram_offset + histogram_size != resume_size){
+        printf("Invalid checkpoint file: %s\n", path);
+        exit(1);
+    }
+    if(!is_valid_configuration(&header->config) || header->placement < 0 || header->placement >= (int)(sizeof(placement_names) / sizeof(placement_names[0]))
+        || memchr(header->arrival_distribution, '\0', sizeof(header->arrival_distribution)) == NULL
+        || header->task_number < 0 || header->event_number < 0 || header->event_number > PARAMETER_MAXIMUM){
+        printf("Invalid checkpoint file: %s\n", path);
+        exit(1);
+    }
+    if(header->workload && workload_file == NULL){
+        printf("Checkpoint is taken with a workload, same --workload must be given\n");
+        exit(1);
+    }
+    if(strcmp(header->arrival_distribution, "trace") == 0 && arrival_trace_file == NULL){
+        printf("Checkpoint is taken with an arrival trace, same --arrival-trace must be given\n");
+        exit(1);
+    }
+
+    configuration kept = config;
+    config = header->config;
+    config.max_message_number = kept.max_message_number > header->event_number ? kept.max_message_number : (int)header->event_number;
+    config.frame_rate = kept.frame_rate;
+    config.worker_number = kept.worker_number;
+    config.replay_speed = kept.replay_speed;
+    config.checkpoint_period = kept.checkpoint_period;
+    config.run_time = kept.run_time;
+    config.memory_period = kept.memory_period;
+    if(!is_valid_snapshot(header)){ // Sections are checked with parameters of snapshot
+        printf("Invalid checkpoint file: %s\n", path);
+        exit(1);
+    }
+    seat_release = header->seat_release;
+    if(!set_placement(placement_names[header->placement])){
+        exit(1);
+    }
+    arrival_distribution = strdup(header->arrival_distribution);
+}
+
+/*
+    Checks that sections of a mapped snapshot are at offsets of its layout, so all of them are in file, and that numbers that are used as indexes are in their ranges
+    config must be parameters of snapshot
+    Returns FALSE if snapshot is truncated or it is not written by this program
+    header: Mapped snapshot
+*/
+BOOL is_valid_snapshot(snapshot_header* header){
+
+    int i = 0;
+    int j = 0;
+    int l = 0;
+    long k = 0;
+    long queue_number = 0;
+    long task_number = 0;
+    char* data = (char*)header;
+    snapshot_header layout = *header;
+    const char* distributions[] = { "uniform", "poisson", "bursty", "trace" };
+    int distribution_number = sizeof(distributions) / sizeof(distributions[0]);
+
+    for(i = 0 ; i < distribution_number && strcmp(distributions[i], header->arrival_distribution) != 0 ; i++);
+    if(i == distribution_number || header->burst_position < 0 || header->burst_position >= BURST_GROUP_NUMBER
+        || header->arrived_student_number < 0 || header->arrived_student_number > config.student_number
+        || header->entered_student_number < 0 || header->entered_student_number > config.student_number
+        || header->left_student_number < 0 || header->left_student_number > config.student_number
+        || header->max_waiting_number < 0 || header->max_waiting_number > config.student_number){
+        return FALSE;
+    }
+
+    set_snapshot_layout(&layout, 0); // Sections before queue section do not depend on queue number
+    if(layout.room_size != header->room_size || layout.library_offset != header->library_offset || (size_t)layout.queue_offset > resume_size){
+        return FALSE;
+    }
+    snapshot_library* library_records = (snapshot_library*)(data + header->library_offset);
+    for(l = 0 ; l < config.library_number ; l++){
+        snapshot_library* record = &library_records[l];
+        if(record->waiting_number < 0 || record->handoff_number < 0 || record->task_number < 0 || record->empty_seat_number < 0
+            || record->empty_seat_number > config.room_capacity * config.room_number || record->placement_cursor < 0){
+            return FALSE;
+        }
+        queue_number += (long)record->waiting_number + record->handoff_number;
+        task_number += record->task_number;
+    }
+    if(queue_number > config.student_number || task_number != header->task_number){
+        return FALSE;
+    }
+    set_snapshot_layout(&layout, queue_number);
+    if(layout.room_offset != header->room_offset || layout.student_offset != header->student_offset || layout.leaving_offset != header->leaving_offset
+        || layout.queue_offset != header->queue_offset || layout.task_offset != header->task_offset || layout.event_offset != header->event_offset
+        || layout.histogram_offset != header->histogram_offset){ // Size of file is already checked against histogram offset
+        return FALSE;
+    }
+
+    for(i = 0 ; i < config.room_number ; i++){
+        snapshot_room* record = (snapshot_room*)(data + header->room_offset + (long)i * header->room_size);
+        int* seats = (int*)(record + 1);
+        if(record->state < EMPTY || record->state > BUSY || record->student_number < 0 || record->student_number > config.room_capacity
+            || record->seated_number < 0 || record->seated_number > config.room_capacity){
+            return FALSE;
+        }
+        for(j = 0 ; j < config.room_capacity ; j++){
+            if(seats[j] < 0 || seats[j] > config.student_number){
+                return FALSE;
+            }
+        }
+    }
+    snapshot_student* student_records = (snapshot_student*)(data + header->student_offset);
+    int* leaving = (int*)(data + header->leaving_offset);
+    for(i = 0 ; i < config.student_number ; i++){
+        snapshot_student* record = &student_records[i];
+        if(record->state < NOT_ENTERED || record->state > LEAVING || record->room_number < UNDEFINED || record->room_number > config.room_number
+            || record->library_number < 0 || record->library_number >= config.library_number
+            || record->working_duration < 0 || record->working_duration > MAX_WORKING_TIME || leaving[i] < 0 || leaving[i] > config.student_number){
+            return FALSE;
+        }
+    }
+    int* queue = (int*)(data + header->queue_offset);
+    for(k = 0 ; k < queue_number ; k++){
+        if(queue[k] < 1 || queue[k] > config.student_number){
+            return FALSE;
+        }
+    }
+    snapshot_task* tasks = (snapshot_task*)(data + header->task_offset);
+    for(k = 0 ; k < task_number ; k++){
+        int function = tasks[k].function;
+        int argument = tasks[k].argument;
+        if(function < 0 || function >= (int)(sizeof(task_functions) / sizeof(task_functions[0]))){
+            return FALSE;
+        }
+        if(task_functions[function] == student_arrival_task ? argument != -1
+            : task_functions[function] == release_task || task_functions[function] == cleaned_task ? argument < 0 || argument >= config.room_number
+            : argument < 0 || argument >= config.student_number){
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+    Restores rooms, students, queues, tasks, events, histograms and random state from mapped snapshot, then unmaps it
+    Clock continues from time of snapshot. Room index is updated from restored rooms
+    Must be called after task queues are created and before any task is run
+*/
+void restore_snapshot(void){
+
+    int i = 0;
+    int j = 0;
+    int l = 0;
+    long k = 0;
+    BOOL has_arrival_task = FALSE;
+    snapshot_header* header = resume_snapshot;
+    char* data = (char*)resume_snapshot;
+
+    if(header->config.student_number != config.student_number){
+        printf("Workload has %d students but checkpoint has %d students\n", config.student_number, header->config.student_number);
+        exit(1);
+    }
+    if(execution_mode == VIRTUAL_MODE){
+        virtual_time = header->elapsed_time;
+    }
+    else{ // Start is moved back, so elapsed time continues from snapshot
+        start.tv_sec -= header->elapsed_time / 1000;
+        start.tv_usec -= (header->elapsed_time % 1000) * 1000;
+        if(start.tv_usec < 0){
+            start.tv_sec -= 1;
+            start.tv_usec += 1000000;
+        }
+    }
+    long now = get_monotonic_time();
+
+    for(i = 0 ; i < config.room_number ; i++){
+        snapshot_room* record = (snapshot_room*)(data + header->room_offset + (long)i * header->room_size);
+        room* rm = get_room(i);
+        rm->state = record->state;
+        rm->student_number = record->student_number;
+        rm->seated_number = record->seated_number;
+        rm->times_used = record->times_used;
+        memcpy(rm->student_id_arr, record + 1, sizeof(int) * config.room_capacity);
+        room_syncs[i].opened_time = record->opened_time == NOT_OPENED ? NOT_OPENED : now + record->opened_time;
+        room_syncs[i].released_time = now + record->released_time;
+        update_room_index(rm);
+    }
+    snapshot_student* student_records = (snapshot_student*)(data + header->student_offset);
+    for(i = 0 ; i < config.student_number ; i++){
+        student* st = &students[i];
+        st->state = student_records[i].state;
+        st->room_number = student_records[i].room_number;
+        st->library_number = student_records[i].library_number;
+        st->working_duration = student_records[i].working_duration;
+        st->entered_time = now + student_records[i].entered_time;
+        st->queued_time = now + student_records[i].queued_time;
+        st->working_time = now + student_records[i].working_time;
+    }
+    int* leaving = (int*)(data + header->leaving_offset);
+    for(i = 0 ; i < config.student_number ; i++){
+        atomic_store(&leaving_order[i], leaving[i]);
+    }
+
+    snapshot_library* library_records = (snapshot_library*)(data + header->library_offset);
+    int* queue = (int*)(data + header->queue_offset);
+    snapshot_task* tasks = (snapshot_task*)(data + header->task_offset);
+    for(l = 0 ; l < config.library_number ; l++){
+        snapshot_library* record = &library_records[l];
+        library* lib = &libraries[l];
+        lib->empty_seat_number = record->empty_seat_number;
+        lib->max_waiting_number = record->max_waiting_number;
+        lib->placement_cursor = record->placement_cursor;
+        lib->admitted_number = record->admitted_number;
+        lib->received_number = record->received_number;
+        lib->task_sequence = record->task_sequence;
+        if(record->waiting_number > lib->waiting_capacity){
+            free(lib->waiting_queue);
+            lib->waiting_capacity = record->waiting_number;
+            lib->waiting_queue = (student**) malloc(sizeof(student*) * lib->waiting_capacity);
+        }
+        for(j = 0 ; j < record->waiting_number ; j++){
+            lib->waiting_queue[j] = &students[*queue++ - 1];
+        }
+        lib->waiting_head = 0;
+        lib->waiting_number = record->waiting_number;
+        atomic_fetch_add(&waiting_student_total, record->waiting_number);
+        for(j = 0 ; j < record->handoff_number ; j++){ // Handoff queue had these students, so they fit again
+            if(!push_handoff(lib, &students[*queue++ - 1])){
+                printf("Handoff queue of library %d in checkpoint is bigger than its capacity\n", l);
+                exit(1);
+            }
+        }
+        while(lib->task_heap_capacity < record->task_number){
+            lib->task_heap_capacity *= 2;
+        }
+        lib->task_heap = (task*) realloc(lib->task_heap, sizeof(task) * lib->task_heap_capacity);
+        for(j = 0 ; j < record->task_number ; j++, tasks++){
+            task* t = &lib->task_heap[j];
+            t->time = tasks->time;
+            t->sequence = tasks->sequence;
+            t->function = task_functions[tasks->function];
+            has_arrival_task = has_arrival_task || t->function == student_arrival_task;
+            t->argument = tasks->argument < 0 ? NULL : t->function == release_task || t->function == cleaned_task ? (void*)get_room(tasks->argument) : (void*)&students[tasks->argument];
+        }
+        lib->task_heap_size = record->task_number;
+    }
+
+    event* events = (event*)(data + header->event_offset);
+    for(k = 0 ; k < header->event_number ; k++){ // Events are written to log like add_event does
+        event_log[k].data = events[k];
+        atomic_store_explicit(&event_log[k].sequence, k + 1, memory_order_release);
+    }
+    atomic_store(&event_log_head, header->event_number);
+    atomic_store(&dropped_event_number, header->dropped_event_number);
+
+    long* values = (long*)(data + header->histogram_offset);
+    for(i = 0 ; i < (int)(sizeof(histograms) / sizeof(histograms[0])) ; i++){
+        histogram* h = histograms[i];
+        atomic_store(&h->count, values[0]);
+        atomic_store(&h->sum, values[1]);
+        atomic_store(&h->max, values[2]);
+        for(j = 0 ; j < HISTOGRAM_BUCKETS ; j++){
+            atomic_store(&h->buckets[j], values[3 + j]);
+        }
+        values += 3 + HISTOGRAM_BUCKETS;
+    }
+
+    random_seed = header->random_seed;
+    arrival_random = header->arrival_random;
+    if(execution_mode == VIRTUAL_MODE){ // Tasks are run by this thread, so random placements continue as in snapshotted run
+        thread_random = header->task_random;
+        thread_random_seeded = TRUE;
+    }
+    if((workload_data != NULL && (header->workload_position < 0 || (size_t)header->workload_position > workload_size))
+        || (arrival_trace_gap_number > 0 && (header->arrival_trace_position < 0 || (size_t)header->arrival_trace_position >= arrival_trace_gap_number))){
+        printf("Checkpoint does not match given workload or arrival trace\n");
+        exit(1);
+    }
+    arrival_trace_position = header->arrival_trace_position;
+    burst_position = header->burst_position;
+    workload_remaining = header->workload_remaining;
+    workload_position = header->workload_position;
+    workload_line = header->workload_line;
+    workload_start_time = header->workload_start_time;
+    workload_arrival_time = header->workload_arrival_time;
+    workload_working_time = header->workload_working_time;
+    arrived_student_number = header->arrived_student_number;
+    atomic_store(&entered_student_number, header->entered_student_number);
+    atomic_store(&total_outgoing_student_number, header->left_student_number);
+    atomic_store(&left_student_total, header->left_student_number);
+    atomic_store(&max_waiting_student_total, header->max_waiting_number);
+    atomic_store(&occupied_seat_time, header->occupied_seat_time);
+    finished_time = header->finished_time;
+    if(header->left_student_number >= config.student_number){ // Nothing is left to simulate
+        atomic_store(&simulation_finished, TRUE);
+        sem_post(&finish_sem);
+    }
+    else if(arrived_student_number < config.student_number && !has_arrival_task){ // Snapshot is taken after arrivals are stopped, so resumed run ends when students in library leave
+        close_arrivals(header->entered_student_number);
+    }
+
+    munmap(resume_snapshot, resume_size);
+    resume_snapshot = NULL;
+}
+
+/*
+    Returns monotonic real time in miliseconds. It is not virtual time even in virtual mode
+*/
+long get_real_time(void){
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+/*
+    Prints result of simulation benchmark as one CSV line with header or one JSON object
+    Served students per second, waiting time, lock hold times, CPU usage and context switches of process are printed
+    seconds: Real duration of simulation
+    cpu_seconds: CPU time that all threads used during simulation
+    context_switches: Context switch number of all threads during simulation
+*/
+void print_benchmark_result(double seconds, double cpu_seconds, long context_switches){
+
+    const char* mode = execution_mode == POOL_MODE ? "pool" : execution_mode == VIRTUAL_MODE ? "virtual" : "thread";
+    int thread_number = 1;
+    if(execution_mode == THREAD_MODE){
+        thread_number = config.student_number + config.room_number;
+    }
+    else if(execution_mode == POOL_MODE){
+        thread_number = config.worker_number > 0 ? config.worker_number : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        thread_number = thread_number < config.library_number ? config.library_number : thread_number;
+    }
+
+    int i = 0;
+    long used_sum = 0;
+    long used_max = 0;
+    double used_deviation = 0;
+    for(i = 0 ; i < config.room_number ; i++){ // Wear balance of rooms is mean absolute deviation and maximum of times used relative to mean
+        long used = atomic_load(&get_room(i)->times_used);
+        used_sum += used;
+        used_max = used > used_max ? used : used_max;
+    }
+    double used_mean = (double)used_sum / config.room_number;
+    for(i = 0 ; i < config.room_number ; i++){
+        double difference = atomic_load(&get_room(i)->times_used) - used_mean;
+        used_deviation += difference < 0 ? -difference : difference;
+    }
+    used_deviation /= config.room_number;
+
+    admission_queue_stats queue_stats;
+    read_admission_queue(&queue_stats);
+    long wait_count = atomic_load(&wait_histogram.count);
+    long room_lock_count = atomic_load(&room_lock_histogram.count);
+    long index_lock_count = atomic_load(&index_lock_histogram.count);
+    double values[] = {
+        seconds,
+        atomic_load(&left_student_total) / seconds,
+        wait_count > 0 ? atomic_load(&wait_histogram.sum) / 1000000.0 / wait_count : 0.0,
+        get_percentile(&wait_histogram, 0.99) / 1000000.0,
+        atomic_load(&wait_histogram.max) / 1000000.0,
+        room_lock_count > 0 ? (double)atomic_load(&room_lock_histogram.sum) / room_lock_count : 0.0,
+        (double)get_percentile(&room_lock_histogram, 0.99),
+        index_lock_count > 0 ? (double)atomic_load(&index_lock_histogram.sum) / index_lock_count : 0.0,
+        (double)get_percentile(&index_lock_histogram, 0.99),
+        (double)queue_stats.max_length,
+        cpu_seconds / seconds * 100,
+        (double)context_switches / atomic_load(&left_student_total),
+        finished_time / 1000.0,
+        get_seat_utilization(),
+        get_sent_student_number() * 100.0 / atomic_load(&left_student_total),
+        used_mean,
+        used_mean > 0 ? used_deviation / used_mean * 100 : 0.0,
+        used_mean > 0 ? used_max / used_mean : 0.0
+    };
+    const char* names[] = {
+        "seconds", "students_per_second", "wait_mean_ms", "wait_p99_ms", "wait_max_ms",
+        "room_lock_mean_ns", "room_lock_p99_ns", "index_lock_mean_ns", "index_lock_p99_ns", "queue_max", "cpu_percent", "context_switches_per_student",
+        "library_seconds", "seat_utilization_percent", "sent_students_percent",
+        "room_use_mean", "room_use_deviation_percent", "room_use_max_ratio"
+    };
+    size_t j = 0;
+
+    if(strcmp(benchmark_format, "json") == 0){
+        printf("{\"mode\":\"%s\",\"placement\":\"%s\",\"threads\":%d,\"libraries\":%d,\"rooms\":%d,\"capacity\":%d,\"students\":%d,\"seed\":%llu", mode, placement_names[placement_policy], thread_number, config.library_number, config.room_number, config.room_capacity, config.student_number, (unsigned long long)random_seed);
+        for(j = 0 ; j < sizeof(values) / sizeof(values[0]) ; j++){
+            printf(",\"%s\":%.3f", names[j], values[j]);
+        }
+        printf(",\"dropped_events\":%zu}\n", atomic_load(&dropped_event_number));
+        return;
+    }
+
+    printf("mode,placement,threads,libraries,rooms,capacity,students,seed");
+    for(j = 0 ; j < sizeof(values) / sizeof(values[0]) ; j++){
+        printf(",%s", names[j]);
+    }
+    printf(",dropped_events\n%s,%s,%d,%d,%d,%d,%d,%llu", mode, placement_names[placement_policy], thread_number, config.library_number, config.room_number, config.room_capacity, config.student_number, (unsigned long long)random_seed);
+    for(j = 0 ; j < sizeof(values) / sizeof(values[0]) ; j++){
+        printf(",%.3f", values[j]);
+    }
+    printf(",%zu\n", atomic_load(&dropped_event_number));
+}
+
+/*
+    Returns user and system CPU time of all threads of process in seconds
+*/
+double get_cpu_time(void){
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+/*
+    Returns voluntary and involuntary context switch number of all threads of process
+*/
+long get_context_switches(void){
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+/*
+    Increases number of students that left from library and wakes up main thread after last student
+    Student is also appended to leaving order, so renderer does not search leaving students
+    In endless mode slot of student is given to a new student instead, leaving order is only kept for a fixed number of students
+    st: Student that left
+*/
+void add_outgoing_student(student* st){
+
+    long left = atomic_fetch_add(&left_student_total, 1) + 1;
+    long closed = atomic_load(&closed_arrival_number);
+    if(closed >= 0 && left >= closed){ // Arrivals are stopped and last student that came is left
+        finish_simulation();
+    }
+    if(endless_mode){
+        free_student(st);
+        return;
+    }
+
+    int order = atomic_fetch_add(&total_outgoing_student_number, 1);
+    if(order >= config.student_number){ // Students of admission benchmark come again after they leave, so they are counted more than once
+        return;
+    }
+    atomic_store(&leaving_order[order], st->number);
+    if(order + 1 == config.student_number){
+        finish_simulation();
+    }
+}
+
+/*
+    Marks simulation as finished and wakes up main thread
+    Last student can be found both by arrivals that are stopped and by a leaving student, simulation is finished only once
+*/
+void finish_simulation(void){
+
+    if(!atomic_exchange(&simulation_finished, TRUE)){
+        finished_time = get_elapsed_time();
+        sem_post(&finish_sem);
+    }
+}
+
+/*
+    Stops arrivals of students. Program ends after students that came are left, their rooms are released and cleaned as usual
+    arrived: Number of students that came since start
+*/
+void close_arrivals(long arrived){
+
+    atomic_store(&closed_arrival_number, arrived);
+    if(atomic_load(&left_student_total) >= arrived){
+        finish_simulation();
+    }
+}
+
+/*
+    Returns TRUE if students must stop coming, because SIGINT or SIGTERM is received or run_time of simulation is passed
+*/
+BOOL is_stop_requested(void){
+
+    return atomic_load(&stop_requested) || (config.run_time > 0 && get_elapsed_time() >= config.run_time);
+}
+
+/*
+    Returns percent of seat time that students sat in seats from start until last student left
+*/
+double get_seat_utilization(void){
+
+    double seat_time = (double)config.room_number * config.room_capacity * finished_time * 1000000;
+
+    return seat_time > 0 ? atomic_load(&occupied_seat_time) * 100.0 / seat_time : 0.0;
+}
+
+/*
+    Returns number of students that are sent to another library because their library had no empty seat
+*/
+long get_sent_student_number(void){
+
+    int l = 0;
+    long sent = 0;
+
+    for(l = 0 ; l < config.library_number ; l++){
+        sent += atomic_load(&libraries[l].received_number);
+    }
+
+    return sent;
+}
+
+/*
+    Initializing room selection index of each library. All rooms are empty at start so all of them are added to heaps
+*/
+void init_room_index(void){
+
+    int i = 0;
+    int l = 0;
+
+    init_room_scan();
+    for(l = 0 ; l < config.library_number ; l++){
+        library* lib = &libraries[l];
+        lib->room_heap = (room_key*) arena_alloc(lib->room_number, sizeof(room_key));
+        lib->room_heap_pos = (int*) arena_alloc(lib->room_number, sizeof(int));
+        lib->room_heap_size = 0;
+        for(i = 0 ; i < lib->room_number ; i++){
+            lib->room_heap_pos[i] = -1;
+        }
+        lib->room_scan_size = (lib->room_number + SCAN_LANES - 1) / SCAN_LANES * SCAN_LANES;
+        lib->room_occupancy = (int*) arena_alloc(lib->room_scan_size, sizeof(int));
+        lib->room_usage = (int*) arena_alloc(lib->room_scan_size, sizeof(int));
+        for(i = 0 ; i < lib->room_scan_size ; i++){ // Padding elements are never selected
+            lib->room_occupancy[i] = -1;
+            lib->room_usage[i] = INT_MAX;
+        }
+        for(i = 0 ; i < lib->room_number ; i++){
+            update_room_index(get_room(lib->first_room + i));
+        }
+    }
+}
+
+/*
+    Updates place of room in room_heap of its library after its student_number, state or times_used is changed.
+    Room is added to heap if it becomes available and removed from heap if it is not available anymore.
+    Must be called while index_mutex of library is locked
+    rm: Room that is changed
+*/
+void update_room_index(room* rm){
+
+    library* lib = get_room_library(rm);
+    int index = rm->number - 1; // Heap keys keep campus index of room, so ties are broken same way in every library
+    int local = index - lib->first_room;
+    int pos = lib->room_heap_pos[local];
+    int student_number = atomic_load(&rm->student_number);
+    int times_used = atomic_load(&rm->times_used);
+    BOOL available = is_room_available(rm);
+
+    lib->room_occupancy[local] = available ? student_number : -1;
+    lib->room_usage[local] = times_used;
+    if(available){
+        if(pos == -1){ // Room is added to end of heap and moved up to its place
+            pos = lib->room_heap_size++;
+            lib->room_heap[pos].index = index;
+            lib->room_heap_pos[local] = pos;
+        }
+        lib->room_heap[pos].student_number = student_number;
+        lib->room_heap[pos].times_used = times_used;
+        sift_up(lib, pos);
+        sift_down(lib, lib->room_heap_pos[local]);
+    }
+    else if(pos != -1){ // Room is replaced with last node of heap
+        swap_heap_nodes(lib, pos, --lib->room_heap_size);
+        lib->room_heap_pos[local] = -1;
+        if(pos < lib->room_heap_size){ // Last node is moved to place of room, it can be moved up or down
+            int moved = lib->room_heap[pos].index - lib->first_room;
+            sift_up(lib, pos);
+            sift_down(lib, lib->room_heap_pos[moved]);
+        }
+    }
+}
+
+/*
+    Returns TRUE if a student can be assigned to room
+    rm: Room that will be checked
+*/
+BOOL is_room_available(room* rm){
+
+    return rm->student_number < config.room_capacity && rm->state != BUSY;
+}
+
+/*
+    Compares two rooms according to their student_number, times_used and index variables
+    Returns TRUE if first room should be selected before second room
+    key_1: Key of first room
+    key_2: Key of second room
+*/
+int comparator(room_key* key_1, room_key* key_2) {
+
+    if(key_1->student_number != key_2->student_number){ // Heap root is least full room for least full placement
+        return placement_policy == LEAST_FULL_PLACEMENT ? key_1->student_number < key_2->student_number : key_1->student_number > key_2->student_number;
+    }
+    if(key_1->times_used != key_2->times_used){
+        return key_1->times_used < key_2->times_used;
+    }
+    return key_1->index < key_2->index;
+
+}
+
+/*
+    Selects room scan kernel according to instruction sets of CPU. AVX2 is used if it is supported, SSE2 is used on other x86 CPUs
+*/
+void init_room_scan(void){
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        find_best_room = find_best_room_avx2;
+        room_scan_kernel = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse2")){
+        find_best_room = find_best_room_sse2;
+        room_scan_kernel = "sse2";
+    }
+#endif
+}
+
+/*
+    Scans packed room arrays and returns index of room that comparator selects first: most students, then least times_used, then smallest index
+    Returns -1 if there is no available room
+    occupancy: Student number of each room, -1 if room is not available
+    usage: times_used of each room
+    size: Element number of arrays
+*/
+int find_best_room_scalar(const int* occupancy, const int* usage, int size){
+
+    int i = 0;
+    int best = -1;
+    int best_occupancy = -1;
+    int best_usage = INT_MAX;
+
+    for(i = 0 ; i < size ; i++){
+        if(occupancy[i] > best_occupancy || (occupancy[i] == best_occupancy && usage[i] < best_usage)){
+            best = i;
+            best_occupancy = occupancy[i];
+            best_usage = usage[i];
+        }
+    }
+
+    return best_occupancy == -1 ? -1 : best;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+    SSE2 version of find_best_room_scalar. Every lane keeps best room of its own elements, then lanes are reduced and first room that has best key is searched
+    SSE2 has no 32 bit min and max, so they are done with compare and masks
+    size: Element number of arrays, multiple of 4
+*/
+__attribute__((target("sse2")))
+int find_best_room_sse2(const int* occupancy, const int* usage, int size){
+
+    int i = 0;
+    int lane = 0;
+    int lane_occupancy[4];
+    int lane_usage[4];
+    __m128i best_occupancy = _mm_set1_epi32(-1);
+    __m128i best_usage = _mm_set1_epi32(INT_MAX);
+
+    for(i = 0 ; i < size ; i += 4){
+        __m128i o = _mm_loadu_si128((const __m128i*)(occupancy + i));
+        __m128i u = _mm_loadu_si128((const __m128i*)(usage + i));
+        __m128i better = _mm_or_si128(_mm_cmpgt_epi32(o, best_occupancy),
+            _mm_and_si128(_mm_cmpeq_epi32(o, best_occupancy), _mm_cmplt_epi32(u, best_usage)));
+        best_occupancy = _mm_or_si128(_mm_and_si128(better, o), _mm_andnot_si128(better, best_occupancy));
+        best_usage = _mm_or_si128(_mm_and_si128(better, u), _mm_andnot_si128(better, best_usage));
+    }
+    _mm_storeu_si128((__m128i*) lane_occupancy, best_occupancy);
+    _mm_storeu_si128((__m128i*) lane_usage, best_usage);
+    for(lane = 1 ; lane < 4 ; lane++){
+        if(lane_occupancy[lane] > lane_occupancy[0] || (lane_occupancy[lane] == lane_occupancy[0] && lane_usage[lane] < lane_usage[0])){
+            lane_occupancy[0] = lane_occupancy[lane];
+            lane_usage[0] = lane_usage[lane];
+        }
+    }
+    if(lane_occupancy[0] == -1){
+        return -1;
+    }
+
+    best_occupancy = _mm_set1_epi32(lane_occupancy[0]);
+    best_usage = _mm_set1_epi32(lane_usage[0]);
+    for(i = 0 ; i < size ; i += 4){ // Key of best room is known, first room that has it is selected
+        __m128i o = _mm_loadu_si128((const __m128i*)(occupancy + i));
+        __m128i u = _mm_loadu_si128((const __m128i*)(usage + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(_mm_cmpeq_epi32(o, best_occupancy), _mm_cmpeq_epi32(u, best_usage))));
+        if(mask != 0){
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return -1;
+}
+
+/*
+    AVX2 version of find_best_room_sse2 that checks 8 rooms in each step
+    size: Element number of arrays, multiple of 8
+*/
+__attribute__((target("avx2")))
+int find_best_room_avx2(const int* occupancy, const int* usage, int size){
 
-} student;
+    int i = 0;
+    int lane = 0;
+    int lane_occupancy[8];
+    int lane_usage[8];
+    __m256i best_occupancy = _mm256_set1_epi32(-1);
+    __m256i best_usage = _mm256_set1_epi32(INT_MAX);
 
+    for(i = 0 ; i < size ; i += 8){
+        __m256i o = _mm256_loadu_si256((const __m256i*)(occupancy + i));
+        __m256i u = _mm256_loadu_si256((const __m256i*)(usage + i));
+        __m256i better = _mm256_or_si256(_mm256_cmpgt_epi32(o, best_occupancy),
+            _mm256_and_si256(_mm256_cmpeq_epi32(o, best_occupancy), _mm256_cmpgt_epi32(best_usage, u)));
+        best_occupancy = _mm256_blendv_epi8(best_occupancy, o, better);
+        best_usage = _mm256_blendv_epi8(best_usage, u, better);
+    }
+    _mm256_storeu_si256((__m256i*) lane_occupancy, best_occupancy);
+    _mm256_storeu_si256((__m256i*) lane_usage, best_usage);
+    for(lane = 1 ; lane < 8 ; lane++){
+        if(lane_occupancy[lane] > lane_occupancy[0] || (lane_occupancy[lane] == lane_occupancy[0] && lane_usage[lane] < lane_usage[0])){
+            lane_occupancy[0] = lane_occupancy[lane];
+            lane_usage[0] = lane_usage[lane];
+        }
+    }
+    if(lane_occupancy[0] == -1){
+        return -1;
+    }
 
-void init_room_student(void);
-void init_semaphores(void);
-void init_threads(pthread_t*, void*, void**, int, int);
-void join_threads(pthread_t*, int);
-void* student_thread(void*);
-void* room_thread(void*);
-int get_most_full_room(void);
-void* print_simulation(void);
-void add_message(char*);
-int comparator(room*, room*);
-void room_arr_copy(room**, room**, int);
-void sort(room**, int);
-
-
-student** students;                         // An struct array that keeps all students and their information
-room** rooms;                               // An struct array that keeps all rooms and their information
-char* message_arr[MAX_MESSAGE_NUMBER];      // Message array that contains messages that send by students and rooms
-int message_number = 0;                     // Total number of sent messages
-sem_t mutex;                                // A mutex that is used to synchronize access to critical regions
-sem_t rooms_sem[ROOM_NUMBER];               // A semaphore array of rooms. This semaphores initialized with 0 value. This means rooms have to wait until any student posts room's semaphore.
-sem_t rooms_mutex[ROOM_NUMBER];             // A mutex array of rooms. This mutexes are used to synchronize mutual access of students that uses common room
-sem_t students_sem;                         // A semaphore that is initialized according to room number multiplied by room capacity.
-sem_t msg_mutex;                            // Student and room threads uses same message array and message number. This mutex is used to synchronize access to this common variables
-int total_outgoing_student_number = 0;      // Keeps total student number that left from library
-struct winsize window;                      // Used to get terminal size
-struct timeval start;                       // Used to reach current time unit of nanoseconds
+    best_occupancy = _mm256_set1_epi32(lane_occupancy[0]);
+    best_usage = _mm256_set1_epi32(lane_usage[0]);
+    for(i = 0 ; i < size ; i += 8){ // Key of best room is known, first room that has it is selected
+        __m256i o = _mm256_loadu_si256((const __m256i*)(occupancy + i));
+        __m256i u = _mm256_loadu_si256((const __m256i*)(usage + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(_mm256_cmpeq_epi32(o, best_occupancy), _mm256_cmpeq_epi32(u, best_usage))));
+        if(mask != 0){
+            return i + __builtin_ctz(mask);
+        }
+    }
 
+    return -1;
+}
 
+#else
 
-int main(void){
+int find_best_room_sse2(const int* occupancy, const int* usage, int size){
 
-    srand(time(NULL));
-    ioctl(0, TIOCGWINSZ, &window);
+    return find_best_room_scalar(occupancy, usage, size);
+}
 
-    if(window.ws_col < 110 || window.ws_row < 45){
-        puts("Please stretch your terminal to run simulation properly\nPress " COLOR_YELLOW "\033[1mENTER\033[0m" COLOR_RESET " to continue...");
-        getchar();
-    }
+int find_best_room_avx2(const int* occupancy, const int* usage, int size){
 
-    pthread_t students_t[STUDENT_NUMBER];   // Student threads
-    pthread_t rooms_t[ROOM_NUMBER];         // Room threads
-    pthread_t simulation_t[1];              // Simulation thread
+    return find_best_room_scalar(occupancy, usage, size);
+}
 
-    init_room_student(); // Initializing student and room arrays with default values
-    init_semaphores();   // Initializing semaphores
+#endif
 
-    init_threads(simulation_t, print_simulation, NULL, 1, FALSE); // Inıtializing simuleation thread
-    gettimeofday(&start, NULL); // The start time of room and student threads are stored in start struct
-    init_threads(rooms_t, room_thread, (void**)rooms, ROOM_NUMBER, FALSE); // Initializing room threads
-    init_threads(students_t, student_thread, (void**)students, STUDENT_NUMBER, TRUE); // Initializing student threads
+/*
+    Measures room scan kernels on random packed arrays of several room numbers and checks that all of them select same room
+    Fastest of SCAN_REPEAT_NUMBER batches is reported for each kernel, like scan benchmark does
+*/
+void run_room_scan_benchmark(void){
 
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int r = 0;
+    int room_numbers[] = { 256, 4096, 65536, 1048576 };
+    const char* kernels[] = { "scalar", "sse2", "avx2" };
+    int (*functions[])(const int*, const int*, int) = { find_best_room_scalar, find_best_room_sse2, find_best_room_avx2 };
+    int kernel_number = 1;
 
-    join_threads(students_t, STUDENT_NUMBER); // Joining student threads
-    join_threads(simulation_t, 1); // Joining simulation thread
+    init_room_scan();
+#if defined(__x86_64__) || defined(__i386__)
+    kernel_number = strcmp(room_scan_kernel, "avx2") == 0 ? 3 : strcmp(room_scan_kernel, "sse2") == 0 ? 2 : 1;
+#endif
 
+    printf("kernel,rooms,ns_per_room,speedup,selected\n");
+    for(r = 0 ; r < (int)(sizeof(room_numbers) / sizeof(room_numbers[0])) ; r++){
+        int size = room_numbers[r];
+        int batch = size < 65536 ? 65536 / size : 1; // Small scans are timed in batches, so clock resolution does not change result
+        int* occupancy = (int*) arena_alloc(size, sizeof(int));
+        int* usage = (int*) arena_alloc(size, sizeof(int));
+        for(i = 0 ; i < size ; i++){
+            occupancy[i] = random_below(get_thread_random(), config.room_capacity + 1) - 1;
+            usage[i] = random_below(get_thread_random(), 100);
+        }
 
-    while(total_outgoing_student_number != STUDENT_NUMBER); // Program waiting until all students are left.
+        int selected[3];
+        double fastest[3] = { -1, -1, -1 };
+        for(j = 0 ; j < SCAN_REPEAT_NUMBER ; j++){ // Kernels are run one after another and fastest batch is kept
+            for(k = 0 ; k < kernel_number ; k++){
+                struct timespec scan_start, scan_stop;
+                clock_gettime(CLOCK_MONOTONIC, &scan_start);
+                for(i = 0 ; i < batch ; i++){
+                    selected[k] = functions[k](occupancy, usage, size);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &scan_stop);
 
+                double nanoseconds = (scan_stop.tv_sec - scan_start.tv_sec) * 1000000000.0 + (scan_stop.tv_nsec - scan_start.tv_nsec);
+                if(fastest[k] < 0 || nanoseconds < fastest[k]){
+                    fastest[k] = nanoseconds;
+                }
+            }
+        }
 
-    if(total_outgoing_student_number == STUDENT_NUMBER){
-        for(int i = 0 ; i < ROOM_NUMBER ; i++){
-            pthread_cancel(rooms_t[i]); // Rooms always wait for new students even if there is no new student. So, room threads are canceled when all students has left.
+        for(k = 0 ; k < kernel_number ; k++){
+            if(selected[k] != selected[0]){
+                printf("Kernel %s selects room %d but scalar kernel selects room %d\n", kernels[k], selected[k] + 1, selected[0] + 1);
+                exit(1);
+            }
+            printf("%s,%d,%.3f,%.2f,%d\n", kernels[k], size, fastest[k] / batch / size, fastest[0] / fastest[k], selected[k] + 1);
         }
     }
+}
 
-    gotoxy(2, 8 + ROOM_NUMBER * 3);
-    printf("Press " COLOR_YELLOW "\033[1mENTER\033[0m" COLOR_RESET " to show logs.%20s\n", " ");
-    getchar();
-
-    for(int k = 0 ; k < message_number ; k++){ // Printing all messages after simulation end
-        printf(" %s", message_arr[k]);
-    }
+/*
+    Swaps two nodes of room_heap and updates their positions
+    lib: Library whose heap is changed
+    i: Position of first node
+    j: Position of second node
+*/
+void swap_heap_nodes(library* lib, int i, int j){
 
-    return 0;
+    room_key tmp = lib->room_heap[i];
+    lib->room_heap[i] = lib->room_heap[j];
+    lib->room_heap[j] = tmp;
+    lib->room_heap_pos[lib->room_heap[i].index - lib->first_room] = i;
+    lib->room_heap_pos[lib->room_heap[j].index - lib->first_room] = j;
 }
 
 /*
-    Initializing room and student arrays with default values
+    Moves node up until its parent has higher priority
+    lib: Library whose heap is changed
+    pos: Position of node
 */
-void init_room_student(void){
+void sift_up(library* lib, int pos){
 
-    students = (student**) malloc(sizeof(student*) * STUDENT_NUMBER);
-    rooms = (room**) malloc(sizeof(room*) * ROOM_NUMBER);
-
-    int i = 0;
-    for(i = 0 ; i < STUDENT_NUMBER ; i++){
-        students[i] = (student*) malloc(sizeof(student));
-        students[i]->number = i + 1;
-        students[i]->state = NOT_ENTERED;
-        students[i]->room_number = UNDEFINED;
-    }
-    for(i = 0 ; i < ROOM_NUMBER ; i++){
-        rooms[i] = (room*) malloc(sizeof(room));
-        rooms[i]->number = i + 1;
-        rooms[i]->state = EMPTY;
-        rooms[i]->student_number = 0;
-        rooms[i]->student_id_arr = (int*) malloc(sizeof(int) * ROOM_CAPACITY);
-        rooms[i]->times_used = 0;
+    while(pos > 0 && comparator(&lib->room_heap[pos], &lib->room_heap[(pos - 1) / 2])){
+        swap_heap_nodes(lib, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
     }
+}
+
+/*
+    Moves node down until its children have lower priority
+    lib: Library whose heap is changed
+    pos: Position of node
+*/
+void sift_down(library* lib, int pos){
 
+    while(TRUE){
+        int best = pos;
+        int left = 2 * pos + 1;
+        int right = 2 * pos + 2;
+        if(left < lib->room_heap_size && comparator(&lib->room_heap[left], &lib->room_heap[best])){
+            best = left;
+        }
+        if(right < lib->room_heap_size && comparator(&lib->room_heap[right], &lib->room_heap[best])){
+            best = right;
+        }
+        if(best == pos){
+            break;
+        }
+        swap_heap_nodes(lib, pos, best);
+        pos = best;
+    }
 }
 
 /*
-    Initializing all semaphores
+    Runs simulation with a fixed number of worker threads instead of a thread per student and room
+    Students and rooms are state machines. Their steps are scheduled as tasks and sleeps are replaced with delayed tasks
+    Each library has at least one worker, workers of a library run only its tasks
+    Returns when all students are left
 */
-void init_semaphores(void){
+void run_pool(void){
 
     int i = 0;
-    sem_init(&mutex, 0, 1); // Mutex starts from 1 and first access will be accepted without any sem_post
-    sem_init(&msg_mutex, 0, 1); // Mutex starts from 1 and first access will be accepted without any sem_post
-    sem_init(&students_sem, 0, ROOM_CAPACITY * ROOM_NUMBER); //Student semaphore starts from room_capacity * room_number because this value indicates maximum number of working student in the rooms. Other students have to wait until any room is empty and this semaphore is posted.
-    for(i = 0 ; i < ROOM_NUMBER ; i++){
-        sem_init(&rooms_sem[i], 0, 0);  // Rooms semaphores starts from zero because room has to wait until any student comes
-        sem_init(&rooms_mutex[i], 0, 1); // Room mutexes start from 1
+    int worker_number = config.worker_number > 0 ? config.worker_number : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(worker_number < config.library_number){
+        worker_number = config.library_number;
+    }
+    pthread_t* workers_t = (pthread_t*) malloc(sizeof(pthread_t) * worker_number);
+    pool_worker_number = worker_number;
+
+    init_task_queue();
+    atomic_store(&pool_running, TRUE);
+    atomic_store(&next_worker_number, 0);
+
+    if(resume_file != NULL){
+        restore_snapshot(); // Tasks of snapshot are scheduled again, arrival task is among them if students are still coming
+    }
+    else{
+        schedule_task(&libraries[0], student_arrival_task, NULL, 0);
     }
+    if(checkpoint_file != NULL){
+        start_checkpoints();
+    }
+    init_threads(workers_t, worker_thread, NULL, 0, worker_number, FALSE);
+
+    sem_wait(&finish_sem); // Pool runs until all students are left
+
+    atomic_store(&pool_running, FALSE);
+    if(checkpoint_file != NULL){
+        stop_checkpoints();
+    }
+    for(i = 0 ; i < worker_number ; i++){
+        sem_post(&libraries[i % config.library_number].task_sem); // Waking up idle workers so they can see pool is stopped
+    }
+    join_threads(workers_t, worker_number);
+    free(workers_t);
 }
 
 /*
-    Initializes threads according to given parameters
-    threads: Thread array
-    function: Function that threads will run
-    struct_arr: Parameters that will send to threads
-    size: Number of threads will be created
-    allow_periods: Indicates threads will be created periodically or directly
+    Runs simulation as a discrete event simulation. Same tasks of pool mode are run one by one by main thread
+    Virtual clock jumps to time of each task instead of waiting, so simulation runs as fast as CPU can run tasks
+    Returns when all students are left. Program ends with an error if no task is left before it, because a stalled simulation has no valid result
 */
-void init_threads(pthread_t* threads, void* function, void** struct_arr, int size, int allow_periods){
+void run_virtual(void){
 
-    int i = 0;
-    for(i = 0 ; i < size ; i++){
-        if(struct_arr == NULL){
-            pthread_create(&threads[i], NULL, function, NULL);
+    struct timespec real_start, real_stop;
+    long task_number = 0;
+    int l = 0;
+
+    init_task_queue();
+    clock_gettime(CLOCK_MONOTONIC, &real_start);
+
+    long checkpoint_time = get_real_time() + config.checkpoint_period;
+
+    if(resume_file != NULL){
+        restore_snapshot();
+    }
+    else{
+        schedule_task(&libraries[0], student_arrival_task, NULL, 0);
+    }
+    long memory_time = 0;
+    while(!atomic_load(&simulation_finished)){
+        if(checkpoint_file != NULL && (task_number & 1023) == 0 && get_real_time() >= checkpoint_time){ // There is only one thread, simulation is consistent between tasks
+            take_checkpoint();
+            checkpoint_time = get_real_time() + config.checkpoint_period;
         }
-        else{
-            pthread_create(&threads[i], NULL, function, struct_arr[i]);
+        library* next = NULL;
+        for(l = 0 ; l < config.library_number ; l++){ // Students that are sent to libraries are received at same virtual time
+            receive_students(&libraries[l]);
+        }
+        for(l = 0 ; l < config.library_number ; l++){ // Earliest task of all libraries is run
+            if(libraries[l].task_heap_size > 0 && (next == NULL || task_before(&libraries[l].task_heap[0], &next->task_heap[0]))){
+                next = &libraries[l];
+            }
+        }
+        if(next == NULL){ // Students are still in library but nothing can happen anymore, so results would be wrong
+            printf("FATAL: SIMULATION IS STALLED AT %ld VIRTUAL MS, %ld OF %ld STUDENTS HAVE LEFT!!!\n", virtual_time,
+                atomic_load(&left_student_total), atomic_load(&entered_student_number));
+            exit(1);
+        }
+        task t = take_task(next);
+        virtual_time = t.time; // Clock moves to time of task, there is no task before it
+        t.function(t.argument);
+        task_number += 1;
+        if(memory_log != NULL && virtual_time >= memory_time){ // Memory is sampled at first task of each period
+            write_memory_sample();
+            memory_time = virtual_time - virtual_time % config.memory_period + config.memory_period;
         }
-        if((i + 1) % STUDENT_NUMBER_PERIOD == 0 && allow_periods){
-            usleep(rand() % STUDENT_INCOMING_PERIOD);
+        if(trace_fd >= 0){ // There is no trace thread in virtual mode, events are moved to trace buffer before event log is full
+            write_trace_events();
         }
     }
+
+    clock_gettime(CLOCK_MONOTONIC, &real_stop);
+    if(checkpoint_file != NULL){
+        wait_checkpoint(0); // Last snapshot is complete before program ends
+    }
+    if(simulation_benchmark_mode){ // Benchmark prints its own result
+        return;
+    }
+    double seconds = (real_stop.tv_sec - real_start.tv_sec) + (double)(real_stop.tv_nsec - real_start.tv_nsec) / 1000000000;
+    printf("%ld students and %d rooms are simulated in %ld virtual ms (%.3f s real time, %ld tasks)\n",
+        atomic_load(&left_student_total), config.room_number, virtual_time, seconds, task_number);
 }
 
 /*
-    Joins threads according to given parameters
-    threads: Thread array
-    size: Size of thread array
+    Allocates task heaps of libraries that are used by pool and virtual modes
 */
-void join_threads(pthread_t* threads, int size){
+void init_task_queue(void){
 
-    int i = 0;
-    for(i = 0 ; i < size ; i++){
-        pthread_join(threads[i], NULL);
+    int l = 0;
+
+    for(l = 0 ; l < config.library_number ; l++){
+        library* lib = &libraries[l];
+        lib->task_heap_capacity = 64;
+        lib->task_heap = (task*) malloc(sizeof(task) * lib->task_heap_capacity);
+        sem_init(&lib->task_mutex, 0, 1);
+        sem_init(&lib->task_sem, 0, 0);
     }
 }
 
 /*
-    Performs operation for a room
+    Runs tasks of a library when their time comes and receives students that are sent to library
+    Workers are given to libraries in turn. If there are several libraries, each worker is pinned to one of cores that process may use, so a library keeps its data in caches of its cores
     Run by a thread
-    room_ptr: Room struct that keeps room information
 */
-void* room_thread(void* room_ptr){
-
-    room* rm = (room*)room_ptr;
-    int i = 0;
+void* worker_thread(void* arg){
 
-    while(TRUE){
+    (void)arg;
+    int worker = atomic_fetch_add(&next_worker_number, 1);
+    library* lib = &libraries[worker % config.library_number];
 
-        if(rm->student_number < ROOM_CAPACITY){ // Indicates room is not full and must wait for a incoming student
-
-            sem_wait(&rooms_sem[rm->number - 1]); // Room waits here until any student posts this semaphore
-            if(rm->state == EMPTY){
-                rm->state = ANNOUNCING; // Room keeper is awaken
-                char* open_msg;
-                struct timeval open_stop;
-                gettimeofday(&open_stop, NULL);
-                asprintf(&open_msg, "Room keeper %d has " COLOR_RED "\033[1mOPENED\033[0m" COLOR_RESET " the room! " COLOR_GREEN "\t\t\t\t%d ms" COLOR_RESET "\n", rm->number,(int)(((double)(open_stop.tv_usec - start.tv_usec) / 1000000 + (double)(open_stop.tv_sec - start.tv_sec)) * 1000));
-                add_message(open_msg);
-            }
-
-            // Room keeper announces left empty seat number
-            char* anounce_msg;
-            struct timeval announce_stop;
-            gettimeofday(&announce_stop, NULL);
-            asprintf(&anounce_msg, "Room keeper %d is " COLOR_RED "\033[1mANNOUNCING\033[0m" COLOR_RESET " %d empty seat left! " COLOR_GREEN "\t\t%d ms" COLOR_RESET "\n", rm->number, ROOM_CAPACITY - rm->student_number, (int)(((double)(announce_stop.tv_usec - start.tv_usec) / 1000000 + (double)(announce_stop.tv_sec - start.tv_sec)) * 1000));
-            add_message(anounce_msg);
-            sem_post(&rooms_mutex[rm->number - 1]); // Allows to new student to continue that is assigned to this room.
-            /*
-                 Actually program can run properly without this mutex
-                 but announcing messages are not working properly because
-                 student_number is common variable for students that are
-                 assigned to this room and they can change this variable
-                 before it printed.
-                 Example condition occurs if mutex is not used:
-
-                    Room keeper 3 ANNOUNCING 2 empty seat left
-                    Room keeper 3 ANNOUNCING 2 empty seat left
-                    Room keeper 3 ANNOUNCING 0 empty seat left
-                    Room keeper 3 ANNOUNCING 0 empty seat left
-
-                *Only message is wrong, program runs properly
-            */
+    cpu_set_t allowed;
+    if(config.library_number > 1 && sched_getaffinity(0, sizeof(allowed), &allowed) == 0){ // Only cores that process may use are taken, for example under taskset or a cpuset
+        int index = worker % CPU_COUNT(&allowed);
+        int cpu = 0;
+        for(cpu = 0 ; cpu < CPU_SETSIZE && !(CPU_ISSET(cpu, &allowed) && index-- == 0) ; cpu++);
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0){ // Worker runs on any allowed core then
+            printf("Worker %d can not be pinned to core %d\n", worker, cpu);
         }
-        else{ // If student number of room reached to ROOM_CAPACITY
+    }
 
-            char* full_msg;
-            struct timeval full_stop;
-            gettimeofday(&full_stop, NULL);
-            asprintf(&full_msg, "Room %d is " COLOR_RED "\033[1mFULL\033[0m" COLOR_RESET " capacity! " COLOR_GREEN "\t\t\t\t\t%d ms" COLOR_RESET "\n", rm->number,(int)(((double)(full_stop.tv_usec - start.tv_usec) / 1000000 + (double)(full_stop.tv_sec - start.tv_sec)) * 1000));
-            add_message(full_msg);
+    while(atomic_load(&pool_running)){
 
-            rm->state = BUSY; // Room state is updated as busy
+        lock_simulation(); // Snapshot is not taken while worker changes simulation
+        receive_students(lib);
 
-            sleep(STUDENT_WORKING_TIME); // Room is sleeping before send student
+        sem_wait(&lib->task_mutex);
+        if(lib->task_heap_size == 0){ // There is no task, worker sleeps until a task is scheduled or a student is sent
+            sem_post(&lib->task_mutex);
+            unlock_simulation();
+            sem_wait(&lib->task_sem);
+            continue;
+        }
 
-            sem_wait(&mutex); // Enter critical region
-            rm->times_used += 1;
-            rm->state = CLEANING;
+        if(lib->task_heap[0].time <= get_elapsed_time()){ // Earliest task is due, it is removed from heap and run
+            task t = take_task(lib);
+            sem_post(&lib->task_mutex);
+            t.function(t.argument);
+            unlock_simulation();
+            continue;
+        }
 
-            for(i = 0; i < ROOM_CAPACITY ; i++){ // Changing states of students that are working in this room as leaving
-                rm->student_number -= 1;
-                students[rm->student_id_arr[i] - 1]->state = LEAVING;
-                rm->student_id_arr[i] = 0;
-                total_outgoing_student_number += 1;
-            }
+        // Worker sleeps until earliest task is due or an earlier task is scheduled
+        struct timespec deadline;
+        long due = lib->task_heap[0].time;
+        sem_post(&lib->task_mutex);
+        unlock_simulation();
+        deadline.tv_sec = start.tv_sec + due / 1000;
+        deadline.tv_nsec = start.tv_usec * 1000 + (due % 1000) * 1000000;
+        if(deadline.tv_nsec >= 1000000000){
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&lib->task_sem, &deadline);
+    }
 
-            sem_post(&mutex); // Exit critical region
-            sleep(ROOM_CLEANING_TIME); // This is not compulsory, only makes simulation looking good. If it is not used we can not see when room is empty because new students directly enter room
+    pthread_exit(NULL);
+}
 
-            for(i = 0; i < ROOM_CAPACITY ; i++){
-                sem_post(&students_sem); // Letting new students to find empty room to study
-            }
+/*
+    Removes earliest task from task heap of library and returns it
+    Task heap must not be empty. In pool mode it must be called while task mutex of library is held
+    lib: Library whose task is taken
+*/
+task take_task(library* lib){
 
+    task t = lib->task_heap[0];
+    lib->task_heap[0] = lib->task_heap[--lib->task_heap_size];
+    int pos = 0;
+    while(TRUE){
+        int best = pos;
+        int left = 2 * pos + 1;
+        int right = 2 * pos + 2;
+        if(left < lib->task_heap_size && task_before(&lib->task_heap[left], &lib->task_heap[best])){
+            best = left;
         }
-
+        if(right < lib->task_heap_size && task_before(&lib->task_heap[right], &lib->task_heap[best])){
+            best = right;
+        }
+        if(best == pos){
+            break;
+        }
+        task tmp = lib->task_heap[pos];
+        lib->task_heap[pos] = lib->task_heap[best];
+        lib->task_heap[best] = tmp;
+        pos = best;
     }
 
-    pthread_exit(NULL);
+    return t;
 }
 
-
 /*
-    Performs operation for a student
-    Run by a thread
-    student_ptr: Student struct that keeps student information
+    Adds a task to task heap of library and wakes up a worker of library
+    lib: Library whose workers run task
+    function: Function that will be run
+    argument: Parameter of function
+    delay: Miliseconds that task will wait before it is run
 */
-void* student_thread(void* student_ptr){
+void schedule_task(library* lib, void (*function)(void*), void* argument, long delay){
 
-    student* st = (student*)student_ptr;
-
-    if(st->state == NOT_ENTERED || st->room_number == UNDEFINED) // Student enters library
-        st->state = WAITING;
+    sem_wait(&lib->task_mutex);
+    if(lib->task_heap_size == lib->task_heap_capacity){
+        lib->task_heap_capacity *= 2;
+        lib->task_heap = (task*) realloc(lib->task_heap, sizeof(task) * lib->task_heap_capacity);
+    }
 
-    char* enter_msg;
-    struct timeval enter_stop;
-    gettimeofday(&enter_stop, NULL);
-    asprintf(&enter_msg, "Student %d has " COLOR_BLUE "\033[1mENTERED\033[0m" COLOR_RESET " into library and started to wait! " COLOR_GREEN "\t%d ms" COLOR_RESET "\n" , st->number, (int)(((double)(enter_stop.tv_usec - start.tv_usec) / 1000000 + (double)(enter_stop.tv_sec - start.tv_sec)) * 1000));
-    add_message(enter_msg);
+    int pos = lib->task_heap_size++;
+    lib->task_heap[pos].time = get_elapsed_time() + delay;
+    lib->task_heap[pos].sequence = lib->task_sequence++;
+    lib->task_heap[pos].function = function;
+    lib->task_heap[pos].argument = argument;
+    while(pos > 0 && task_before(&lib->task_heap[pos], &lib->task_heap[(pos - 1) / 2])){
+        task tmp = lib->task_heap[pos];
+        lib->task_heap[pos] = lib->task_heap[(pos - 1) / 2];
+        lib->task_heap[(pos - 1) / 2] = tmp;
+        pos = (pos - 1) / 2;
+    }
+    sem_post(&lib->task_mutex);
 
-    sem_wait(&students_sem); // If there is no empty room students have to wait
-    sem_wait(&mutex); // Enter critical region
-    st->room_number = get_most_full_room(); // Student is assigned to most full less used room
-    if(st->room_number == -1){ // This condition never happening while program is working properly (I tested so many times :) ). But if it comes true, program will crush down
-        /*
-            This condition can be true if and only if all rooms are full and any room posted students_sem while it is still full. This is impossible
-        */
-        printf("FATAL: AN UNEXPECTED ERROR HAS OCCURED AND STUDENT %d HAS BEEN TERMINATED!!!\n", st->number);
-        pthread_exit(NULL);
+    if(execution_mode == POOL_MODE){ // There is no worker to wake up in virtual mode
+        sem_post(&lib->task_sem);
     }
+}
 
-    st->state = WORKING; // Student is assigned to a room and started working
-    char* work_msg;
-    struct timeval work_stop;
-    gettimeofday(&work_stop, NULL);
-    asprintf(&work_msg, "Student %d " COLOR_BLUE "\033[1mWORKING\033[0m" COLOR_RESET " in the %d. room! " COLOR_GREEN "\t\t\t\t%d ms" COLOR_RESET "\n", st->number, st->room_number, (int)(((double)(work_stop.tv_usec - start.tv_usec) / 1000000 + (double)(work_stop.tv_sec - start.tv_sec)) * 1000));
-    add_message(work_msg);
-    sem_wait(&rooms_mutex[st->room_number - 1]); // If any student is assigned to same room before this student must wait until room keeper sends announce and posts mutex.
-    rooms[st->room_number - 1]->student_id_arr[rooms[st->room_number - 1]->student_number] = st->number; // Number of this student is added to student number array of assigned room
-    rooms[st->room_number - 1]->student_number += 1; // Student number of assigned room is increased
-    sem_post(&rooms_sem[st->room_number - 1]); // Waking up room keeper or letting to announce
-    sem_post(&mutex); // Exit critical region
+/*
+    Returns TRUE if first task should be run before second task
+    task_1: First task
+    task_2: Second task
+*/
+BOOL task_before(task* task_1, task* task_2){
 
+    if(task_1->time != task_2->time){
+        return task_1->time < task_2->time;
+    }
+    return task_1->sequence < task_2->sequence;
+}
 
-    long starvation_detect_start = time(NULL);
-    while(st->state == WORKING){ // Student working until state is changed by room. Room changes this state to leaving if it is full
+/*
+    Lets next group of students enter library and schedules next group after a period of arrival distribution like init_threads
+    argument: Not used
+*/
+void student_arrival_task(void* argument){
 
-        /*
-            If the room never be full, student detects that he worked too much. And leaves the room.
-        */
-        if(time(NULL) - starvation_detect_start > STUDENT_WORKING_TIME + 3){
-            sem_wait(&mutex);
-            char* starvation_msg;
-            struct timeval startvation_stop;
-            gettimeofday(&startvation_stop, NULL);
-            asprintf(&starvation_msg, COLOR_RED "STARVATION DETECTED " COLOR_RESET "Student %d " COLOR_BLUE "\033[1mLEAVING\033[0m" COLOR_RESET " from %d. room! " COLOR_GREEN "\t\t%d ms" COLOR_RESET "\n", st->number, st->room_number, (int)(((double)(startvation_stop.tv_usec - start.tv_usec) / 1000000 + (double)(startvation_stop.tv_sec - start.tv_sec)) * 1000));
-            add_message(starvation_msg);
-            rooms[st->room_number-1]->student_number -= 1;
-            st->state = LEAVING;
-            total_outgoing_student_number += 1;
-            sem_post(&mutex);
-            pthread_exit(NULL);
+    (void)argument;
+    int i = 0;
+    long arrival_time = 0;
+
+    if(is_stop_requested()){ // Students in library leave, task is not scheduled again
+        close_arrivals(atomic_load(&entered_student_number));
+        return;
+    }
+    BOOL blocked = FALSE; // Handoff queue of home library of next student is full
+    if(workload_data != NULL){ // All students whose arrival time is passed enter, then task is scheduled to next arrival time
+        while(arrived_student_number < config.student_number && peek_workload_arrival(&arrival_time) && arrival_time <= get_elapsed_time()){
+            student* st = &students[arrived_student_number];
+            if(!has_handoff_space(st)){
+                blocked = TRUE;
+                break;
+            }
+            arrived_student_number += 1;
+            take_workload_student(st);
+            arrive_student(st);
+        }
+    }
+    else if(endless_mode){
+        for(i = 0 ; i < config.student_number_period ; i++){
+            student* st = take_free_student();
+            if(st == NULL){ // All slots are in library, group is smaller
+                break;
+            }
+            if(!has_handoff_space(st)){
+                free_student(st); // Slot is taken again when task is run again
+                blocked = TRUE;
+                break;
+            }
+            arrive_student(st);
+        }
+    }
+    else{
+        for(i = 0 ; i < config.student_number_period && arrived_student_number < config.student_number ; i++){
+            if(!has_handoff_space(&students[arrived_student_number])){
+                blocked = TRUE;
+                break;
+            }
+            arrive_student(&students[arrived_student_number++]);
         }
     }
+    if(config.library_number == 1 && config.admission_batch > 1){ // Other libraries admit students when they receive them
+        admit_waiting_students(&libraries[0]);
+    }
+
+    if(blocked){ // Workers of full library receive its students in the meantime, then a new group comes
+        schedule_task(&libraries[0], student_arrival_task, NULL, HANDOFF_RETRY_PERIOD);
+    }
+    else if(endless_mode || arrived_student_number < config.student_number){
+        long delay = workload_data != NULL ? arrival_time - get_elapsed_time() : next_arrival_gap() / 1000;
+        schedule_task(&libraries[0], student_arrival_task, NULL, delay > 0 ? delay : 0);
+    }
+}
 
-    char* leave_msg;
-    struct timeval leave_stop;
-    gettimeofday(&leave_stop, NULL);
-    asprintf(&leave_msg, "Student %d " COLOR_BLUE "\033[1mLEAVING\033[0m" COLOR_RESET " from %d. room! " COLOR_GREEN "\t\t\t\t%d ms" COLOR_RESET "\n", st->number, st->room_number, (int)(((double)(leave_stop.tv_usec - start.tv_usec) / 1000000 + (double)(leave_stop.tv_sec - start.tv_sec)) * 1000));
-    add_message(leave_msg);
+/*
+    Student enters library and waits for an empty seat
+    If there are several libraries, student is sent to its home library and workers of that library seat it
+    st: Student that arrives
+*/
+void arrive_student(student* st){
 
-    pthread_exit(NULL);
+    st->state = WAITING; // Student enters library
+    add_event(EVENT_ENTERED, 0, st->number, 0);
+    record_entering(st);
+    if(config.library_number > 1){
+        library* lib = get_student_library(st);
+        while(!push_handoff(lib, st)){ // Arrival task checked that queue has room, workers can only fill it in a short race. Students are received here then
+            receive_students(lib);
+        }
+    }
+    else if(config.admission_batch > 1){
+        enqueue_student(st); // Whole group is admitted together after it arrives
+    }
+    else{
+        request_seat(st);
+    }
 }
 
 /*
-    Returns most full and less used room number
+    Student that is received by a library waits for an empty seat in it
+    If its home library has no empty seat for it, it is sent to library that has most empty seats for waiting students. A student is sent only once, so it never goes around libraries
+    st: Student that is received
 */
-int get_most_full_room(void){
+void request_admission(student* st){
 
-    int i = 0;
-    int max_student_number = -1;
-    int most_full_room_id = -1;
-    room** rooms_tmp = (room**)malloc(sizeof(room*) * ROOM_NUMBER);
-    room_arr_copy(rooms_tmp, rooms, ROOM_NUMBER); // Copies rooms array to another array because it will sort this array and real array should not be affected
+    library* lib = get_student_library(st);
 
-    sort(rooms_tmp, ROOM_NUMBER); // Sorts rooms according to their times_used variable
+    if(config.library_number > 1 && st->library_number == (st->number - 1) % config.library_number && lib->empty_seat_number <= lib->waiting_number){
+        library* spare = find_spare_library(lib);
+        if(spare != NULL){
+            st->library_number = spare->number;
+            if(push_handoff(spare, st)){
+                atomic_fetch_add(&spare->received_number, 1);
+                return;
+            }
+            st->library_number = lib->number; // Handoff queue of other library is full, student waits in its home library
+        }
+    }
 
-    for(i = 0 ; i < ROOM_NUMBER ; i++){
+    if(config.admission_batch > 1){
+        enqueue_student(st); // Students that are received together are admitted as a group
+    }
+    else{
+        request_seat(st);
+    }
+}
 
-        /*
-            Selects room that is the most full but not completely full.
-            This selection gives most full less used room because the
-            array is already sorted and it gives priority to rooms that
-            has lower index if rooms have same student number
-        */
+/*
+    Seats students that are sent to library until its handoff queue is empty
+    Returns number of received students
+    lib: Library that receives students
+*/
+int receive_students(library* lib){
 
-        if(rooms_tmp[i]->student_number < ROOM_CAPACITY && rooms_tmp[i]->state != BUSY && rooms_tmp[i]->student_number > max_student_number){
+    int received = 0;
+    student* st = NULL;
 
-            max_student_number = rooms_tmp[i]->student_number;
-            most_full_room_id = rooms_tmp[i]->number;
-        }
+    while((st = pop_handoff(lib)) != NULL){
+        request_admission(st);
+        received += 1;
+    }
+    if(received > 0 && config.admission_batch > 1){
+        admit_waiting_students(lib);
     }
 
-    return most_full_room_id;
+    return received;
 }
 
-
 /*
-    Prints all data reached from rooms and students arrays.
-    There are too many magical numbers that is used to align values.
-    It is not worth to explain.
+    Returns library that has most empty seats that are not waited by any student, or NULL if no library other than lib has one
+    Counters of other libraries are read without their locks, so result is only a hint
+    lib: Library that is full
 */
-void* print_simulation(void){
+library* find_spare_library(library* lib){
 
-    int leaving_students[STUDENT_NUMBER] = { 0 };
-    int leaving_student_number = 0;
-
-    while(leaving_student_number < STUDENT_NUMBER){
-
-        clear();
-        gotoxy(window.ws_col / 2 - strlen(PROGRAM_NAME), 0);
-        printf(COLOR_BLUE PROGRAM_NAME COLOR_RESET "\n");
-
-
-        gotoxy(3, 3);
-        printf(COLOR_MAGENTA "ROOM\n NUMBER" COLOR_RESET "\n");
-        gotoxy((ROOM_CAPACITY * 7 - 6 )/ 2 + 10, 3);
-        printf(COLOR_MAGENTA "STUDENT" COLOR_RESET "\n");
-        gotoxy((ROOM_CAPACITY * 7 - 6 )/ 2 + 10, 4);
-        printf(COLOR_MAGENTA "NUMBERS" COLOR_RESET "\n");
-        gotoxy(ROOM_CAPACITY * 7 + 13, 3);
-        printf(COLOR_MAGENTA "TIMES" COLOR_RESET "\n");
-        gotoxy(ROOM_CAPACITY * 7 + 13, 4);
-        printf(COLOR_MAGENTA "USED" COLOR_RESET "\n");
-
-        int i = 0;
-        // Start draw room slots
-        for(i = 0 ; i < ROOM_NUMBER ; i++){
-            int j = 0;
-            gotoxy(4, 6 + i * 3);
-            printf(COLOR_YELLOW "%2d" COLOR_RESET "\n", i + 1);
-            gotoxy(ROOM_CAPACITY * 7 + 15, 6 + i * 3);
-            printf(COLOR_YELLOW "%d" COLOR_RESET "\n", rooms[i]->times_used);
-            for(j = 0 ; j < ROOM_CAPACITY ; j++){
-                gotoxy(10 + j * 7, 5 + i * 3);
-                printf(COLOR_GREEN "________\n" COLOR_RESET "\n");
-                gotoxy(10 + j * 7, 6 + i * 3);
-                printf(COLOR_GREEN "|      |\n" COLOR_RESET "\n");
-                gotoxy(10 + j * 7, 7 + i * 3);
-                printf(COLOR_GREEN "‾‾‾‾‾‾‾‾\n" COLOR_RESET "\n");
-            }
-        }
-        // End draw room slots
-
-        // Start fill room slots
-        for(i = 0 ; i < ROOM_NUMBER ; i++){
-            int j = 0;
-            for(j = 0 ; j < rooms[i]->student_number ; j++){
-                gotoxy(13 + j * 7, 6 + i * 3);
-                printf(COLOR_RESET "%d" COLOR_RESET "\n",rooms[i]->student_id_arr[j]);
-            }
-        }
-        // End fill room slots
-
-        //Start list waiting students
-        int student_num_per_line = (int)(STUDENT_NUMBER / ROOM_NUMBER);
-        gotoxy(ROOM_CAPACITY * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 3);
-        printf(COLOR_MAGENTA "STUDENTS" COLOR_RESET "\n");
-        gotoxy(ROOM_CAPACITY * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 4);
-        printf(COLOR_MAGENTA "WAITING" COLOR_RESET "\n");
-        int line = 0;
-        int count = 0;
-        for(i = 0 ; i < STUDENT_NUMBER ; i++){
-
-            if(students[i]->state == WAITING){
-                gotoxy(ROOM_CAPACITY * 7 + 18 + 5 + count * 4, line + 6);
-                printf(COLOR_RED "%d " COLOR_RESET "\n", students[i]->number);
-                count += 1;
-
-                if(count == student_num_per_line){
-                    line += 1;
-                    count = 0;
-                }
-            }
+    int l = 0;
+    int best_spare = 0;
+    library* best = NULL;
+
+    for(l = 0 ; l < config.library_number ; l++){
+        int spare = atomic_load_explicit(&libraries[l].empty_seat_number, memory_order_relaxed) - atomic_load_explicit(&libraries[l].waiting_number, memory_order_relaxed);
+        if(l != lib->number && spare > best_spare){
+            best_spare = spare;
+            best = &libraries[l];
         }
-        //End list waiting students
+    }
 
-        //Start list leaving students
-        int z = 0;
-        for(z = 0 ; z < STUDENT_NUMBER ; z++){
+    return best;
+}
 
-            if(students[z]->state == LEAVING){
+/*
+    Adds student to handoff queue of library without any lock and wakes up a worker of library
+    Each slot has a sequence number like event log, so several threads can send students at the same time
+    Returns FALSE if queue is full
+    lib: Library that student is sent to
+    st: Student that is sent
+*/
+BOOL push_handoff(library* lib, student* st){
 
-                BOOL flag = FALSE;
-                int t = 0;
-                for(t = 0 ; t < leaving_student_number ; t++){
-                    if(leaving_students[t] == students[z]->number){
-                        flag = TRUE;
-                    }
-                }
-                if(!flag){
-                    leaving_students[leaving_student_number++] = students[z]->number;
-                }
+    size_t pos = atomic_load_explicit(&lib->handoff_head, memory_order_relaxed);
+    while(TRUE){
+        handoff_slot* slot = &lib->handoff_queue[pos & (lib->handoff_capacity - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)pos;
+        if(difference == 0){ // Slot is empty, it is reserved if no other thread took it
+            if(atomic_compare_exchange_weak_explicit(&lib->handoff_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)){
+                slot->data = st;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                break;
             }
         }
+        else if(difference < 0){ // Slot is not read yet, queue is full
+            return FALSE;
+        }
+        else{
+            pos = atomic_load_explicit(&lib->handoff_head, memory_order_relaxed);
+        }
+    }
 
-        gotoxy(ROOM_CAPACITY * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 10 + STUDENT_NUMBER / student_num_per_line);
-        printf(COLOR_MAGENTA "STUDENTS" COLOR_RESET "\n");
-        gotoxy(ROOM_CAPACITY * 7 + 18 + 5 + (student_num_per_line * 4 - 8)/2, 11 + STUDENT_NUMBER / student_num_per_line);
-        printf(COLOR_MAGENTA "LEAVING" COLOR_RESET "\n");
-        count = 0;
-        line = 0;
-        for(i = 0 ; i < leaving_student_number ; i++){
+    if(execution_mode == POOL_MODE){
+        sem_post(&lib->task_sem);
+    }
+    return TRUE;
+}
 
+/*
+    Returns TRUE if arriving student can be sent to its home library, always TRUE if there is one library
+    Arrival task does not wait for a full handoff queue or empty it, workers of that library do it. A slot is kept for each worker, because workers can send students to library at the same time
+    st: Student that will arrive
+*/
+BOOL has_handoff_space(student* st){
 
-            gotoxy(ROOM_CAPACITY * 7 + 18 + 5 + count * 4, line + 13 + STUDENT_NUMBER / student_num_per_line);
-            printf(COLOR_RED "%d " COLOR_RESET "\n", leaving_students[i]);
-            count += 1;
+    if(config.library_number == 1){
+        return TRUE;
+    }
+    library* lib = get_student_library(st);
+    size_t tail = atomic_load(&lib->handoff_tail); // Tail is read first, so used slots are never less than real number
+    size_t used = atomic_load(&lib->handoff_head) - tail;
 
-            if(count == student_num_per_line){
-                line += 1;
-                count = 0;
-            }
-        }
-        //End list leaving students
+    return used + pool_worker_number < lib->handoff_capacity;
+}
 
-        gotoxy(2, 8 + ROOM_NUMBER * 3);
-        puts("Logs will be available after simulation end.");
+/*
+    Removes first student from handoff queue of library without any lock
+    Returns student or NULL if queue is empty
+    lib: Library that receives student
+*/
+student* pop_handoff(library* lib){
 
-        usleep(100000); //100 MILISECONDS
+    size_t pos = atomic_load_explicit(&lib->handoff_tail, memory_order_relaxed);
+    while(TRUE){
+        handoff_slot* slot = &lib->handoff_queue[pos & (lib->handoff_capacity - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if(difference == 0){ // Slot is written, it is taken if no other worker took it
+            if(atomic_compare_exchange_weak_explicit(&lib->handoff_tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)){
+                student* st = slot->data;
+                atomic_store_explicit(&slot->sequence, pos + lib->handoff_capacity, memory_order_release);
+                return st;
+            }
+        }
+        else if(difference < 0){ // Slot is not written yet, queue is empty
+            return NULL;
+        }
+        else{
+            pos = atomic_load_explicit(&lib->handoff_tail, memory_order_relaxed);
+        }
     }
-
-    pthread_exit(NULL);
 }
 
 /*
-    Adds message to message_arr synchronously
-    message: Message that will be added
+    Student takes an empty seat if there is one, otherwise it waits in queue
+    This is same as waiting in admission queue of student_thread but worker is not blocked. Seat is given later by free_seats
+    st: Student that wants to work
 */
-void add_message(char* message){
+void request_seat(student* st){
 
-    sem_wait(&msg_mutex);
-    message_arr[message_number++] = message;
-    sem_post(&msg_mutex);
+    if(enter_admission_queue(st)){
+        schedule_task(get_student_library(st), admit_student_task, st, 0);
+    }
 }
 
 /*
-    Copies room array to given another array
-    dest: Destionation array
-    src: Source array
-    len: Length of source array
+    Assigns student to most full less used room, then room keeper announces
+    Same steps as student_thread and room_thread do after an empty seat is given
+    student_ptr: Student that has an empty seat
 */
-void room_arr_copy(room** dest, room** src, int len){
+void admit_student_task(void* student_ptr){
 
-    int i = 0;
+    student* st = (student*)student_ptr;
 
-    for(i = 0 ; i < len ; i++){
+    st->room_number = select_room(get_student_library(st)); // Student is assigned to most full less used room and a seat is claimed in its library
+    if(st->room_number == -1){
+        printf("FATAL: AN UNEXPECTED ERROR HAS OCCURED AND STUDENT %d HAS BEEN TERMINATED!!!\n", st->number);
+        return;
+    }
 
-        dest[i] = (room*) malloc(sizeof(room));
-        dest[i]->number = src[i]->number;
-        dest[i]->state = src[i]->state;
+    room* rm = get_room(st->room_number - 1);
+    library* lib = get_room_library(rm);
+    BOOL full = seat_student(st);
 
-        dest[i]->student_id_arr = (int*)malloc(sizeof(int) * ROOM_CAPACITY);
-        int j = 0;
-        for(j = 0 ; j < ROOM_CAPACITY ; j++){
-            dest[i]->student_id_arr[j] = src[i]->student_id_arr[j];
-        }
+    if(seat_release){
+        schedule_task(lib, seat_release_task, st, st->working_duration);
+        return;
+    }
+    st->starvation_time = get_elapsed_time() + st->working_duration + STARVATION_TIME;
+    schedule_task(lib, starvation_task, st, st->working_duration + STARVATION_TIME);
+    if(full){
+        mark_room_busy(rm);
+        schedule_task(lib, release_task, rm, get_room_working_time(rm));
+    }
+}
 
-        dest[i]->student_number = src[i]->student_number;
-        dest[i]->times_used = src[i]->times_used;
+/*
+    Student leaves room if room has not sent it until now
+    student_ptr: Student that is working
+*/
+void starvation_task(void* student_ptr){
 
+    student* st = (student*)student_ptr;
+    if(get_elapsed_time() < st->starvation_time){ // Task of previous student of slot, current student has its own task
+        return;
     }
+    starve_student(st);
 }
 
 /*
-    Bubble sort algorithm to sort given room array according to comparator function
-    src: Source array
-    len: Length of source array
+    Student leaves library after room sent it
+    student_ptr: Student that is sent by room
 */
-void sort(room** src, int len){
-
-    int i = 0, j = 0;
+void leave_task(void* student_ptr){
 
-    for(i = 0 ; i < len-1 ; i++){
-        for(j = 0 ; j < len-i-1 ; j++){
-            if(comparator(src[j], src[j+1])){
-                room* tmp = src[j];
-                src[j] = src[j+1];
-                src[j+1] = tmp;
-            }
-        }
-    }
+    student* st = (student*)student_ptr;
+    add_event(EVENT_LEAVING, st->room_number, st->number, 0);
+    add_outgoing_student(st);
 }
 
 /*
-    Compares two rooms according to their times_used variable
-    rm_1: First room
-    rm_2: Second room
+    Student frees its seat after its own working time
+    student_ptr: Student that is working
 */
-int comparator(room* rm_1, room* rm_2) {
+void seat_release_task(void* student_ptr){
+
+    leave_room((student*)student_ptr);
+}
 
-    return (rm_1->times_used > rm_2->times_used);
+/*
+    Room sends its students after they worked and starts cleaning
+    room_ptr: Room that is full
+*/
+void release_task(void* room_ptr){
 
+    room* rm = (room*)room_ptr;
+    release_room(rm);
+    schedule_task(get_room_library(rm), cleaned_task, rm, config.room_cleaning_time * 1000);
 }
 
+/*
+    Seats of room are given to waiting students after room is cleaned
+    room_ptr: Room that is cleaned
+*/
+void cleaned_task(void* room_ptr){
+
+    room* rm = (room*)room_ptr;
+    record_cleaning(rm);
+    add_event(EVENT_CLEANED, rm->number, 0, 0);
+    free_seats(get_room_library(rm), config.room_capacity); // Letting waiting students to find empty room to study
+}